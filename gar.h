@@ -10,24 +10,141 @@ extern "C" {
 
 typedef struct gar gar_t; ///< Archive file.
 typedef struct gar_fstat gar_fstat_t; ///< Zipped file's status.
+typedef struct gar_entry_stat gar_entry_stat_t; ///< Zipped file's metadata.
 typedef struct gar_fdata gar_fdata_t; ///< Zipped file's data stream.
 typedef struct gar_gfile gar_gfile_t; ///< Generalized file (see garlib.h).
+typedef struct gar_allocator gar_allocator_t; ///< Memory allocator.
+typedef struct gar_arena gar_arena_t; ///< Memory arena.
+typedef struct gar_zindex gar_zindex_t; ///< Access points of a zipped file.
+typedef struct gar_stats gar_stats_t; ///< Statistics of archives.
+typedef struct gar_stream gar_stream_t; ///< Forward-only reader of archive.
+typedef struct gar_open_opts gar_open_opts_t; ///< Options of gar_open_ex().
+typedef unsigned long long gar_off_t; ///< Offset or size in files (64bits).
 
 struct gar_fstat {
   const char *fname;
-  size_t fsize;
+  gar_off_t fsize;
+};
+
+#define GAR_ENTRY_STAT_VERSION 1 ///< Version of gar_entry_stat_t.
+
+/// Zipped file's metadata given by gar_enum_ex(); the later versions only
+/// append the members.
+struct gar_entry_stat {
+  unsigned version; ///< GAR_ENTRY_STAT_VERSION of the library.
+  const char *name; ///< View of the name in the archive's index.
+  size_t name_len; ///< Length of the name, which may not be NUL-terminated.
+  unsigned method; ///< Compression method (0: stored, 8: deflated).
+  gar_off_t comp_size;
+  gar_off_t fsize; ///< Uncompressed size.
+  unsigned long crc32;
+  gar_off_t hdr_off; ///< Offset of the local file header in the archive.
+  unsigned long mtime; ///< MS-DOS date (upper 16bits) and time (lower 16bits).
+};
+
+/// Stages of which the time is measured; the inflate stage includes the
+/// io and the table stages spent by the decompression.
+enum gar_stage {
+  GAR_STAGE_LOOKUP, ///< Looking up the zipped files by name, and gar_enum*().
+  GAR_STAGE_HEADER, ///< Reading the local file headers.
+  GAR_STAGE_IO, ///< Reading the archive file.
+  GAR_STAGE_INFLATE, ///< Decompressing the data.
+  GAR_STAGE_TABLE, ///< Building the Huffman tables.
+  GAR_STAGE_CRC, ///< Computing the CRC-32 values.
+  GAR_NUM_STAGES
+};
+
+struct gar_stats {
+  unsigned long long read_calls; ///< Reads of the archive file.
+  unsigned long long read_bytes;
+  unsigned long long seeks;
+  unsigned long long headers; ///< Local file headers read.
+  unsigned long long blocks[3]; ///< Deflate blocks by BTYPE.
+  unsigned long long tables; ///< Huffman tables built.
+  unsigned long long literals; ///< Literal symbols decoded.
+  unsigned long long matches; ///< Length/distance pairs decoded.
+  unsigned long long out_bytes; ///< Decompressed bytes.
+  unsigned long long ns[GAR_NUM_STAGES]; ///< Nanoseconds by gar_stage.
+};
+
+/// Options of gar_open_ex(); the zero members are the defaults.
+struct gar_open_opts {
+  size_t bufsize; ///< Bytes of the compressed data read at once (32KB).
+  gar_off_t readahead; ///< Bytes advised to be read ahead, or 0 (none).
+  const gar_zindex_t *index; ///< Access points (see gar_open_indexed()).
+  size_t async; ///< Chunks (64KB) decompressed ahead by a thread, or 0.
 };
 
 typedef int(*gar_enum_t)(const gar_fstat_t *fstat, void *ud, jmp_buf env);
+typedef int(*gar_enum_ex_t)(const gar_entry_stat_t *st, void *ud,
+                            jmp_buf env);
+typedef void(*gar_release_t)(void *ptr, size_t len);
+typedef void(*gar_write_t)(void *ud, const void *ptr, size_t n, jmp_buf env);
+
+/// Allocate (ptr == NULL), reallocate or free (nsize == 0) a memory block,
+/// like lua_Alloc of Lua; returns NULL if it fails to allocate.
+typedef void *(*gar_alloc_t)(void *ud, void *ptr, size_t osize, size_t nsize);
+
+struct gar_allocator {
+  gar_alloc_t fn;
+  void *ud;
+};
+typedef int(*gar_sink_t)(const gar_fstat_t *fstat, const void *ptr, void *ud,
+                         jmp_buf env);
 
 gar_t *gar_archive_open_file(const char *fname, jmp_buf env);
+gar_t *gar_archive_open_mmap(const char *fname, jmp_buf env);
+gar_t *gar_archive_open_memory(const void *ptr, size_t len,
+                               gar_release_t release, jmp_buf env);
 gar_t *gar_archive_gopen(gar_gfile_t *gf, jmp_buf env);
 void gar_archive_close(gar_t *G);
+void gar_set_verify(gar_t *G, int on);
+void gar_set_parallel(gar_t *G, int nthreads, gar_off_t chunk);
+void gar_get_pool_stats(gar_t *G, unsigned long *hits, unsigned long *misses);
+void gar_set_stats(gar_t *G, int on);
+void gar_get_stats(const gar_t *G, gar_stats_t *S);
+void gar_reset_stats(gar_t *G);
 int gar_enum(gar_t *G, gar_enum_t fn, void *ud, jmp_buf env);
+int gar_enum_ex(gar_t *G, gar_enum_ex_t fn, void *ud, jmp_buf env);
+int gar_enum_prefix(gar_t *G, const char *prefix, gar_enum_ex_t fn, void *ud,
+                    jmp_buf env);
+int gar_list_dir(gar_t *G, const char *dir, gar_enum_ex_t fn, void *ud,
+                 jmp_buf env);
 int gar_stat(gar_t *G, const char *fname, gar_fstat_t *fstat, jmp_buf env);
 gar_fdata_t *gar_open(gar_t *G, const char *fname, jmp_buf env);
 size_t gar_read(gar_fdata_t *fd, void *ptr, size_t n, jmp_buf env);
 void gar_close(gar_fdata_t *fd);
+gar_fdata_t *gar_open_indexed(gar_t *G, const char *fname,
+                              const gar_zindex_t *X, jmp_buf env);
+gar_fdata_t *gar_open_ex(gar_t *G, const char *fname,
+                         const gar_open_opts_t *opts, jmp_buf env);
+void gar_seek(gar_fdata_t *fd, gar_off_t off, jmp_buf env);
+gar_zindex_t *gar_zindex_build(gar_t *G, const char *fname, gar_off_t span,
+                               jmp_buf env);
+void gar_zindex_save(const gar_zindex_t *X, gar_write_t fn, void *ud,
+                     jmp_buf env);
+gar_zindex_t *gar_zindex_load(const gar_gfile_t *gf, jmp_buf env);
+void gar_zindex_close(gar_zindex_t *X);
+int gar_read_all(gar_t *G, const char *fname, void **ptr, size_t *len,
+                 jmp_buf env);
+int gar_read_into(gar_t *G, const char *fname, void *ptr, size_t n,
+                  size_t *len, jmp_buf env);
+void gar_free(void *ptr);
+int gar_extract_many(gar_t *G, const char *const fnames[], size_t n,
+                     gar_sink_t fn, void *ud, int nthreads, jmp_buf env);
+
+gar_stream_t *gar_stream_gopen(gar_gfile_t *gf, jmp_buf env);
+int gar_stream_next(gar_stream_t *S, gar_fstat_t *fstat, jmp_buf env);
+size_t gar_stream_read(gar_stream_t *S, void *ptr, size_t n, jmp_buf env);
+void gar_stream_close(gar_stream_t *S);
+
+void gar_set_allocator(const gar_allocator_t *A);
+void gar_archive_set_allocator(gar_t *G, const gar_allocator_t *A);
+gar_arena_t *gar_arena_new(size_t chunk_size, jmp_buf env);
+const gar_allocator_t *gar_arena_allocator(gar_arena_t *a);
+size_t gar_arena_size(const gar_arena_t *a);
+void gar_arena_reset(gar_arena_t *a);
+void gar_arena_close(gar_arena_t *a);
 
 #ifdef __cplusplus
 } // extern "C"
@@ -1,7 +1,81 @@
 // garalloc.c : allocate/reallocate/free memory blocks.
 
 #include "garaux.h"
+#include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
+
+
+//-----------------------------------------------------------------------------
+// Allocator
+
+/**
+ * @brief Header of a memory block.
+ *
+ * Each memory block remembers the allocator and the size, so that it is
+ * freed by the allocator which allocated it, wherever it is freed.
+ */
+typedef union block_header {
+  struct {
+    const gar_allocator_t *A;
+    size_t n;
+  } h;
+  long double align; // keep the alignment of the memory block.
+} block_header_t;
+
+
+static void *default_alloc(void *ud, void *ptr, size_t osize, size_t nsize) {
+  ((void)ud);
+  ((void)osize);
+  if (nsize == 0) {
+    free(ptr);
+    return NULL;
+  }
+  return realloc(ptr, nsize);
+}
+
+
+static const gar_allocator_t c_default_allocator = { &default_alloc, NULL };
+
+static const gar_allocator_t *s_global_allocator = &c_default_allocator;
+
+static __thread const gar_allocator_t *s_current_allocator = NULL;
+
+
+/**
+ * @brief Set the allocator of the archives opened afterward.
+ *
+ * The allocator must be alive until all the memory blocks allocated by it are
+ * freed. NULL restores the default allocator (the C runtime's malloc()).
+ * The allocator is called from any thread using the library, including the
+ * worker threads of the library itself, so it must be thread-safe. This
+ * function must not be called while the library is used by the other
+ * threads.
+ */
+void gar_set_allocator(const gar_allocator_t *A) {
+  s_global_allocator = (A != NULL) ? A : &c_default_allocator;
+}
+
+
+/// Get the allocator of the archives opened afterward.
+const gar_allocator_t *_gar_global_allocator(void) {
+  return s_global_allocator;
+}
+
+
+/// Get the allocator used by the calling thread (NULL for the global one).
+const gar_allocator_t *_gar_current_allocator(void) {
+  return s_current_allocator;
+}
+
+
+/// Set the allocator used by the calling thread (NULL for the global one).
+/// @return the previous allocator of the calling thread.
+const gar_allocator_t *_gar_use_allocator(const gar_allocator_t *A) {
+  const gar_allocator_t *prev = s_current_allocator;
+  s_current_allocator = A;
+  return prev;
+}
 
 
 static void on_out_of_memory(jmp_buf env) {
@@ -9,20 +83,233 @@ static void on_out_of_memory(jmp_buf env) {
 }
 
 
+/// Allocate a memory block by the specified allocator.
+void *_gar_malloc_by(const gar_allocator_t *A, size_t n, jmp_buf env) {
+  block_header_t *b;
+
+  if (n > (size_t)-1 - sizeof(block_header_t)) on_out_of_memory(env);
+  b = (*A->fn)(A->ud, NULL, 0, sizeof(block_header_t) + n);
+  if (b == NULL) on_out_of_memory(env);
+  b->h.A = A;
+  b->h.n = n;
+  return b + 1;
+}
+
+
 void *_gar_malloc(size_t n, jmp_buf env) {
-  void *ptr = malloc(n);
-  if (ptr == NULL) on_out_of_memory(env);
-  return ptr;
+  const gar_allocator_t *A = s_current_allocator;
+  return _gar_malloc_by((A != NULL) ? A : s_global_allocator, n, env);
 }
 
 
 void *_gar_realloc(void *p, size_t n, jmp_buf env) {
-  void *newptr = realloc(p, n);
-  if (newptr == NULL) on_out_of_memory(env);
-  return newptr;
+  block_header_t *b;
+  const gar_allocator_t *A;
+
+  if (p == NULL) return _gar_malloc(n, env);
+
+  b = (block_header_t *)p - 1;
+  A = b->h.A;
+  if (n > (size_t)-1 - sizeof(block_header_t)) on_out_of_memory(env);
+  b = (*A->fn)(A->ud, b, sizeof(block_header_t) + b->h.n,
+               sizeof(block_header_t) + n);
+  if (b == NULL) on_out_of_memory(env);
+  b->h.n = n;
+  return b + 1;
 }
 
 
 void _gar_free(void *p) {
-  free(p);
+  block_header_t *b;
+
+  if (p != NULL) {
+    b = (block_header_t *)p - 1;
+    (*b->h.A->fn)(b->h.A->ud, b, sizeof(block_header_t) + b->h.n, 0);
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+// Arena
+
+#define arena_align sizeof(block_header_t)
+
+
+/// Chunk of memory in which the blocks are allocated.
+typedef struct arena_chunk {
+  struct arena_chunk *next;
+  size_t size; // number of the bytes of data[].
+  block_header_t data[1];
+} arena_chunk_t;
+
+
+struct gar_arena {
+  gar_allocator_t allocator;
+  pthread_mutex_t lock; // serializes the allocations from many threads.
+  arena_chunk_t *chunk; // the current chunk, followed by the full ones.
+  size_t used; // number of the used bytes in the current chunk.
+  size_t chunk_size;
+  size_t total; // number of the bytes allocated from the arena.
+  void *last; // the last allocated block, which can be freed/extended.
+};
+
+
+static size_t round_up(size_t n) {
+  return (n + arena_align - 1) / arena_align * arena_align;
+}
+
+
+/// Allocate @a n bytes from the arena (n > 0).
+static void *arena_take(gar_arena_t *a, size_t n) {
+  arena_chunk_t *c = a->chunk;
+  size_t m = round_up(n);
+  void *p;
+
+  if (m < n) return NULL; // overflow.
+
+  // Add a new chunk if the current one is short.
+  if (c == NULL || c->size - a->used < m) {
+    size_t size = (m > a->chunk_size) ? m : a->chunk_size;
+    c = malloc(offsetof(arena_chunk_t, data) + size);
+    if (c == NULL) return NULL;
+    c->next = a->chunk;
+    c->size = size;
+    a->chunk = c;
+    a->used = 0;
+  }
+
+  p = (char *)c->data + a->used;
+  a->used += m;
+  a->total += m;
+  a->last = p;
+  return p;
+}
+
+
+/**
+ * @brief Allocate/reallocate/free a block of the arena.
+ *
+ * The blocks are freed only by gar_arena_reset() or gar_arena_close(), except
+ * the last allocated block, which is freed or extended in place.
+ */
+static void *arena_update(gar_arena_t *a, void *ptr, size_t osize,
+                          size_t nsize) {
+  void *p;
+
+  if (ptr != NULL && ptr == a->last) {
+    size_t m = round_up(nsize);
+    size_t o = round_up(osize);
+    if (nsize == 0) { // free the last block.
+      a->used -= o;
+      a->total -= o;
+      a->last = NULL;
+      return NULL;
+    }
+    if (m >= nsize && a->used - o + m <= a->chunk->size) {
+      a->used = a->used - o + m;
+      a->total = a->total - o + m;
+      return ptr;
+    }
+  }
+
+  if (nsize == 0) {
+    return NULL; // freed by the arena.
+  }
+
+  p = arena_take(a, nsize);
+  if (p != NULL && ptr != NULL) {
+    memcpy(p, ptr, (osize < nsize) ? osize : nsize);
+  }
+  return p;
+}
+
+
+/// Allocate/reallocate/free a block of the arena under the lock, since an
+/// archive calls its allocator from many threads (e.g. gar_extract_many()).
+static void *arena_alloc(void *ud, void *ptr, size_t osize, size_t nsize) {
+  gar_arena_t *a = (gar_arena_t *)ud;
+  void *p;
+
+  pthread_mutex_lock(&a->lock);
+  p = arena_update(a, ptr, osize, nsize);
+  pthread_mutex_unlock(&a->lock);
+  return p;
+}
+
+
+/**
+ * @brief Create a new arena.
+ *
+ * An arena allocates the memory blocks by bumping a pointer in the large
+ * chunks of @a chunk_size bytes (or larger), and frees them all at once.
+ * The allocations are serialized by a lock, so that an archive shared by
+ * many threads can allocate from it; gar_arena_reset() and
+ * gar_arena_close() must not be called while the arena is used.
+ */
+gar_arena_t *gar_arena_new(size_t chunk_size, jmp_buf env) {
+  gar_arena_t *a = malloc(sizeof(gar_arena_t));
+  if (a == NULL) on_out_of_memory(env);
+  a->allocator.fn = &arena_alloc;
+  a->allocator.ud = a;
+  pthread_mutex_init(&a->lock, NULL);
+  a->chunk = NULL;
+  a->used = 0;
+  a->chunk_size = (chunk_size > 0) ? chunk_size : 65536;
+  a->total = 0;
+  a->last = NULL;
+  return a;
+}
+
+
+/// Get the allocator which allocates the memory blocks from the arena.
+const gar_allocator_t *gar_arena_allocator(gar_arena_t *a) {
+  return &a->allocator;
+}
+
+
+/// Get the number of the bytes allocated from the arena.
+size_t gar_arena_size(const gar_arena_t *a) {
+  pthread_mutex_t *lock = (pthread_mutex_t *)&a->lock;
+  size_t total;
+
+  pthread_mutex_lock(lock);
+  total = a->total;
+  pthread_mutex_unlock(lock);
+  return total;
+}
+
+
+/// Free all the memory blocks of the arena at once; the largest chunk is
+/// kept to be reused.
+void gar_arena_reset(gar_arena_t *a) {
+  arena_chunk_t *c = a->chunk;
+  arena_chunk_t *keep = NULL;
+  arena_chunk_t *next;
+
+  for (; c != NULL; c = next) {
+    next = c->next;
+    if (keep == NULL || c->size > keep->size) {
+      free(keep);
+      keep = c;
+    } else {
+      free(c);
+    }
+  }
+  if (keep != NULL) keep->next = NULL;
+
+  a->chunk = keep;
+  a->used = 0;
+  a->total = 0;
+  a->last = NULL;
+}
+
+
+/// Free the arena and all its memory blocks.
+void gar_arena_close(gar_arena_t *a) {
+  if (a != NULL) {
+    gar_arena_reset(a);
+    free(a->chunk);
+    pthread_mutex_destroy(&a->lock);
+    free(a);
+  }
 }
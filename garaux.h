@@ -10,12 +10,100 @@ extern "C" {
 
 void _gar_error(jmp_buf env, const char *pre, const char *msg)
   __attribute__((noreturn));
+extern __thread int _gar_silent; ///< Nonzero not to display the errors.
 
 void *_gar_malloc(size_t n, jmp_buf env) __attribute__((malloc));
+void *_gar_malloc_by(const gar_allocator_t *A, size_t n, jmp_buf env)
+  __attribute__((malloc));
 void *_gar_realloc(void *p, size_t n, jmp_buf env);
 void _gar_free(void *p);
+const gar_allocator_t *_gar_global_allocator(void);
+const gar_allocator_t *_gar_current_allocator(void);
+const gar_allocator_t *_gar_use_allocator(const gar_allocator_t *A);
 
-void _gar_setup_gfile(gar_gfile_t *gf, const gar_gfile_t *fn, void *ud);
+void _gar_setup_gfile(gar_gfile_v *gf, const gar_gfile_t *fn, void *ud);
+void _gar_gfile_part_readahead(const gar_gfile_t *gf, gar_off_t n);
+
+int _gar_zip64_extra(const unsigned char *s, size_t n, gar_off_t *uncomp_size,
+                     gar_off_t *comp_size, gar_off_t *hdr_off);
+
+typedef struct gar_ipool gar_ipool_t; ///< Pool of the decompressors.
+
+gar_ipool_t *_gar_ipool_new(const gar_allocator_t *A, jmp_buf env);
+void _gar_ipool_release(gar_ipool_t *P);
+void _gar_ipool_stats(gar_ipool_t *P, unsigned long *hits,
+                      unsigned long *misses);
+void _gar_inflate(gar_gfile_v *gf, gar_ipool_t *P, const gar_open_opts_t *O,
+                  jmp_buf env);
+size_t _gar_inflate_buffer(const gar_gfile_t *gf, void *ptr, size_t n,
+                           gar_ipool_t *P, jmp_buf env);
+size_t _gar_inflate_unused(const gar_gfile_t *gf);
+gar_zindex_t *_gar_zindex_new(gar_off_t span, jmp_buf env);
+gar_zindex_t *_gar_zindex_build(const gar_gfile_t *gf, gar_off_t span,
+                                gar_ipool_t *P, jmp_buf env);
+
+typedef struct gar_counters gar_counters_t; ///< Statistics of an archive.
+
+void _gar_gfile_async(gar_gfile_v *gf, size_t depth, gar_counters_t *C,
+                      jmp_buf env);
+size_t _gar_inflate_parallel(const gar_gfile_t *gf, void *ptr, size_t n,
+                             int nthreads, gar_off_t chunk, gar_ipool_t *P,
+                             gar_counters_t *C, jmp_buf env);
+
+#ifndef GAR_NO_STATS
+
+/// Counters of the calling thread, flushed at the end of each call.
+typedef struct gar_tstats {
+  gar_stats_t s;
+  int on; ///< Whether the current call is measured.
+} gar_tstats_t;
+
+extern __thread gar_tstats_t _gar_tstats;
+
+/// Counters saved by _gar_stats_begin() and restored by _gar_stats_end().
+typedef struct gar_stats_scope {
+  gar_stats_t saved;
+  int on; ///< The previous value of gar_tstats_t::on.
+  int measured; ///< Whether the call is measured.
+} gar_stats_scope_t;
+
+#define GAR_STAT_ADD(field, n) ((void)(_gar_tstats.s.field += (n)))
+#define GAR_STAT_START() (_gar_tstats.on ? _gar_clock() : 0)
+#define GAR_STAT_STOP(stage, t) \
+  ((void)((t) != 0 && (_gar_tstats.s.ns[stage] += _gar_clock() - (t))))
+
+gar_counters_t *_gar_counters_new(jmp_buf env);
+gar_counters_t *_gar_counters_share(gar_counters_t *C);
+void _gar_counters_release(gar_counters_t *C);
+gar_counters_t *_gar_counters_total(void);
+void _gar_counters_set(gar_counters_t *C, int on);
+void _gar_counters_get(const gar_counters_t *C, gar_stats_t *S);
+void _gar_counters_reset(gar_counters_t *C);
+void _gar_stats_begin(gar_stats_scope_t *S, gar_counters_t *C);
+void _gar_stats_end(gar_stats_scope_t *S, gar_counters_t *C);
+unsigned long long _gar_clock(void);
+
+#else // GAR_NO_STATS
+
+typedef struct gar_stats_scope {
+  int on;
+} gar_stats_scope_t;
+
+#define GAR_STAT_ADD(field, n) ((void)(n))
+#define GAR_STAT_START() 0ULL
+#define GAR_STAT_STOP(stage, t) ((void)(t))
+
+#define _gar_counters_new(env) ((gar_counters_t *)NULL)
+#define _gar_counters_share(C) (C)
+#define _gar_counters_release(C) ((void)(C))
+#define _gar_counters_total() ((gar_counters_t *)NULL)
+#define _gar_counters_set(C, on) ((void)(C), (void)(on))
+#define _gar_counters_get(C, S) ((void)(C), memset((S), 0, sizeof(gar_stats_t)))
+#define _gar_counters_reset(C) ((void)(C))
+#define _gar_stats_begin(S, C) ((void)(S), (void)(C))
+#define _gar_stats_end(S, C) ((void)(S), (void)(C))
+
+#endif // GAR_NO_STATS
 
 #ifdef __cplusplus
 } // extern "C"
@@ -0,0 +1,1025 @@
+// garbench : measure the throughput and the latency of the library
+
+#include "gar.h"
+#include "garlib.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+
+typedef unsigned char byte_t;
+
+
+//-----------------------------------------------------------------------------
+// Auxiliary
+
+static void die(const char *msg) {
+  fprintf(stderr, "garbench: %s\n", msg);
+  exit(1);
+}
+
+
+static void *xmalloc(size_t n) {
+  void *p = malloc(n > 0 ? n : 1);
+  if (p == NULL) die("out of memory");
+  return p;
+}
+
+
+static void *xrealloc(void *p, size_t n) {
+  p = realloc(p, n > 0 ? n : 1);
+  if (p == NULL) die("out of memory");
+  return p;
+}
+
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+/// Deterministic pseudo random numbers (xorshift64*).
+static unsigned long long s_rand = 88172645463325252ULL;
+
+static unsigned long long rand64(void) {
+  s_rand ^= s_rand >> 12;
+  s_rand ^= s_rand << 25;
+  s_rand ^= s_rand >> 27;
+  return s_rand * 2685821657736338717ULL;
+}
+
+
+static size_t rand_below(size_t n) {
+  return (size_t)(rand64() % n);
+}
+
+
+/// Growable byte string.
+typedef struct bytes {
+  byte_t *p;
+  size_t len;
+  size_t cap;
+} bytes_t;
+
+
+static void bytes_put(bytes_t *b, const void *p, size_t n) {
+  if (b->len + n > b->cap) {
+    b->cap = (b->len + n) * 2;
+    b->p = xrealloc(b->p, b->cap);
+  }
+  memcpy(&b->p[b->len], p, n);
+  b->len += n;
+}
+
+
+static void bytes_put_byte(bytes_t *b, int c) {
+  byte_t x = (byte_t)c;
+  bytes_put(b, &x, 1);
+}
+
+
+static void bytes_put_u16(bytes_t *b, unsigned long x) {
+  bytes_put_byte(b, (int)(x & 0xff));
+  bytes_put_byte(b, (int)((x >> 8) & 0xff));
+}
+
+
+static void bytes_put_u32(bytes_t *b, unsigned long x) {
+  bytes_put_u16(b, x & 0xffff);
+  bytes_put_u16(b, (x >> 16) & 0xffff);
+}
+
+
+//-----------------------------------------------------------------------------
+// Corpus
+
+/// Text of the words of Zipf-like frequencies.
+static void make_text(bytes_t *b, size_t n) {
+  static char words[512][12];
+  static int ready = 0;
+  size_t i, col = 0;
+
+  if (!ready) {
+    for (i = 0; i < 512; i++) {
+      size_t k, len = 2 + rand_below(8);
+      for (k = 0; k < len; k++) words[i][k] = (char)('a' + rand_below(26));
+      words[i][len] = '\0';
+    }
+    ready = 1;
+  }
+
+  while (b->len < n) {
+    // The square of a uniform number makes the leading words frequent.
+    size_t r = rand_below(512);
+    const char *w = words[r * r / 512];
+    bytes_put(b, w, strlen(w));
+    col += strlen(w) + 1;
+    if (col > 72) {
+      bytes_put_byte(b, '\n');
+      col = 0;
+    } else {
+      bytes_put_byte(b, ' ');
+    }
+  }
+  b->len = n;
+}
+
+
+/// Binary records of slowly changing integers and floats.
+static void make_binary(bytes_t *b, size_t n) {
+  unsigned long seq = 0;
+  float x = 0.0f;
+
+  while (b->len < n) {
+    bytes_put_u32(b, seq++);
+    bytes_put_u32(b, (unsigned long)rand_below(16));
+    x += (float)rand_below(100) / 100.0f;
+    bytes_put(b, &x, sizeof(x));
+    bytes_put_u16(b, 0);
+    bytes_put_u16(b, 0xffff);
+  }
+  b->len = n;
+}
+
+
+/// Incompressible bytes, like already compressed data.
+static void make_random(bytes_t *b, size_t n) {
+  while (b->len < n) {
+    unsigned long long r = rand64();
+    bytes_put(b, &r, sizeof(r));
+  }
+  b->len = n;
+}
+
+
+//-----------------------------------------------------------------------------
+// Deflate Writer
+
+typedef enum btype { BT_STORED, BT_FIXED, BT_DYNAMIC } btype_t;
+
+static const char *const c_btype_name[] = { "stored", "fixed", "dynamic" };
+
+
+/// LSB-first bit writer.
+typedef struct bitw {
+  bytes_t out;
+  unsigned long long acc;
+  int n;
+} bitw_t;
+
+
+static void put_bits(bitw_t *w, unsigned long x, int n) {
+  w->acc |= (unsigned long long)x << w->n;
+  w->n += n;
+  while (w->n >= 8) {
+    bytes_put_byte(&w->out, (int)(w->acc & 0xff));
+    w->acc >>= 8;
+    w->n -= 8;
+  }
+}
+
+
+static void flush_bits(bitw_t *w) {
+  if (w->n > 0) put_bits(w, 0, 8 - w->n);
+}
+
+
+/// Put a Huffman code, whose bits are packed from the MSB.
+static void put_code(bitw_t *w, unsigned long code, int len) {
+  unsigned long r = 0;
+  int i;
+  for (i = 0; i < len; i++) {
+    r = (r << 1) | ((code >> i) & 1);
+  }
+  put_bits(w, r, len);
+}
+
+
+/// Match or literal (dist == 0).
+typedef struct token {
+  unsigned short len; // match length, or literal byte.
+  unsigned short dist;
+} token_t;
+
+
+static const unsigned short c_len_base[29] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+};
+static const byte_t c_len_bits[29] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+static const unsigned short c_dist_base[30] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+  257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385,
+  24577,
+};
+static const byte_t c_dist_bits[30] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+  7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+};
+static const byte_t c_clen_order[19] = {
+  16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15,
+};
+
+
+static int len_code(int len) {
+  int c = 28;
+  while (c_len_base[c] > len) c--;
+  return c;
+}
+
+
+static int dist_code(int dist) {
+  int c = 29;
+  while (c_dist_base[c] > dist) c--;
+  return c;
+}
+
+
+/// Find the matches greedily by a hash table of 3 bytes.
+static token_t *lz77(const byte_t *p, size_t n, size_t *ntok, int use_match) {
+  const size_t hash_size = 1 << 15;
+  size_t *head = xmalloc(sizeof(size_t) * hash_size);
+  token_t *t = xmalloc(sizeof(token_t) * (n + 1));
+  size_t i = 0, k = 0;
+
+  for (i = 0; i < hash_size; i++) head[i] = (size_t)-1;
+
+  i = 0;
+  while (i < n) {
+    size_t len = 0, cand = (size_t)-1, h = 0;
+    if (use_match && i + 3 <= n) {
+      h = ((p[i] << 10) ^ (p[i+1] << 5) ^ p[i+2]) & (hash_size - 1);
+      cand = head[h];
+      head[h] = i;
+    }
+    if (cand != (size_t)-1 && i - cand <= 32768) {
+      while (len < 258 && i + len < n && p[cand+len] == p[i+len]) len++;
+    }
+    if (len >= 3) {
+      t[k].len = (unsigned short)len;
+      t[k].dist = (unsigned short)(i - cand);
+      i += len;
+    } else {
+      t[k].len = p[i];
+      t[k].dist = 0;
+      i++;
+    }
+    k++;
+  }
+
+  free(head);
+  *ntok = k;
+  return t;
+}
+
+
+/// Make the code lengths of at most @a limit bits from the frequencies.
+static void make_lengths(const unsigned long *freq, int n, int limit,
+                         byte_t *len) {
+  unsigned long w[2 * 320];
+  int parent[2 * 320];
+  int alive[2 * 320];
+  unsigned long f[320];
+  int i, m, maxlen;
+
+  for (i = 0; i < n; i++) f[i] = freq[i];
+
+  for (;;) {
+    // Build the Huffman tree by merging the two lightest nodes.
+    m = n;
+    for (i = 0; i < n; i++) {
+      w[i] = f[i];
+      alive[i] = (f[i] > 0);
+      parent[i] = -1;
+    }
+    for (;;) {
+      int a = -1, b = -1;
+      for (i = 0; i < m; i++) {
+        if (!alive[i]) continue;
+        if (a < 0 || w[i] < w[a]) {
+          b = a;
+          a = i;
+        } else if (b < 0 || w[i] < w[b]) {
+          b = i;
+        }
+      }
+      if (b < 0) break;
+      w[m] = w[a] + w[b];
+      alive[m] = 1;
+      parent[m] = -1;
+      alive[a] = alive[b] = 0;
+      parent[a] = parent[b] = m;
+      m++;
+    }
+
+    // Get the depths of the leaves.
+    maxlen = 0;
+    for (i = 0; i < n; i++) {
+      int d = 0, j = i;
+      if (f[i] == 0) {
+        len[i] = 0;
+        continue;
+      }
+      while (parent[j] >= 0) {
+        j = parent[j];
+        d++;
+      }
+      len[i] = (byte_t)d;
+      if (d > maxlen) maxlen = d;
+    }
+    if (maxlen <= limit) return;
+
+    // Flatten the frequencies and retry.
+    for (i = 0; i < n; i++) {
+      if (f[i] > 0) f[i] = f[i] / 2 + 1;
+    }
+  }
+}
+
+
+/// Make the canonical codes from the code lengths.
+static void make_codes(const byte_t *len, int n, unsigned long *code) {
+  unsigned long bl_count[16] = { 0 };
+  unsigned long next[16];
+  unsigned long c = 0;
+  int i;
+
+  for (i = 0; i < n; i++) bl_count[len[i]]++;
+  bl_count[0] = 0;
+  for (i = 1; i < 16; i++) {
+    c = (c + bl_count[i-1]) << 1;
+    next[i] = c;
+  }
+  for (i = 0; i < n; i++) {
+    if (len[i] != 0) code[i] = next[len[i]]++;
+  }
+}
+
+
+static void put_tokens(bitw_t *w, const token_t *t, size_t ntok,
+                       const unsigned long *lcode, const byte_t *llen,
+                       const unsigned long *dcode, const byte_t *dlen) {
+  size_t i;
+
+  for (i = 0; i < ntok; i++) {
+    if (t[i].dist == 0) {
+      put_code(w, lcode[t[i].len], llen[t[i].len]);
+    } else {
+      int lc = len_code(t[i].len);
+      int dc = dist_code(t[i].dist);
+      put_code(w, lcode[257 + lc], llen[257 + lc]);
+      put_bits(w, t[i].len - c_len_base[lc], c_len_bits[lc]);
+      put_code(w, dcode[dc], dlen[dc]);
+      put_bits(w, t[i].dist - c_dist_base[dc], c_dist_bits[dc]);
+    }
+  }
+  put_code(w, lcode[256], llen[256]);
+}
+
+
+static void put_fixed_block(bitw_t *w, const token_t *t, size_t ntok,
+                            int final) {
+  byte_t llen[288], dlen[30];
+  unsigned long lcode[288], dcode[30];
+  int i;
+
+  for (i = 0; i < 288; i++) {
+    llen[i] = (i < 144) ? 8 : (i < 256) ? 9 : (i < 280) ? 7 : 8;
+  }
+  for (i = 0; i < 30; i++) dlen[i] = 5;
+  make_codes(llen, 288, lcode);
+  make_codes(dlen, 30, dcode);
+
+  put_bits(w, final, 1);
+  put_bits(w, 1, 2);
+  put_tokens(w, t, ntok, lcode, llen, dcode, dlen);
+}
+
+
+static void put_dynamic_block(bitw_t *w, const token_t *t, size_t ntok,
+                              int final) {
+  unsigned long lfreq[286] = { 0 }, dfreq[30] = { 0 }, cfreq[19] = { 0 };
+  byte_t llen[286], dlen[30], clen[19], all[316];
+  unsigned long lcode[286], dcode[30], ccode[19];
+  int i, hclen;
+  size_t k;
+
+  // Count the symbols; make sure that each code has two symbols at least.
+  for (k = 0; k < ntok; k++) {
+    if (t[k].dist == 0) {
+      lfreq[t[k].len]++;
+    } else {
+      lfreq[257 + len_code(t[k].len)]++;
+      dfreq[dist_code(t[k].dist)]++;
+    }
+  }
+  lfreq[256]++;
+  if (lfreq[0] == 0) lfreq[0] = 1;
+  if (dfreq[0] == 0) dfreq[0] = 1;
+  if (dfreq[1] == 0) dfreq[1] = 1;
+
+  make_lengths(lfreq, 286, 15, llen);
+  make_lengths(dfreq, 30, 15, dlen);
+  make_codes(llen, 286, lcode);
+  make_codes(dlen, 30, dcode);
+
+  // The code lengths are written as they are (no run-length codes).
+  memcpy(all, llen, 286);
+  memcpy(&all[286], dlen, 30);
+  for (i = 0; i < 316; i++) cfreq[all[i]]++;
+  if (cfreq[16] == 0) cfreq[16] = 1; // keep two symbols at least.
+  make_lengths(cfreq, 19, 7, clen);
+  make_codes(clen, 19, ccode);
+  for (hclen = 19; hclen > 4 && clen[c_clen_order[hclen-1]] == 0; hclen--) {
+  }
+
+  put_bits(w, final, 1);
+  put_bits(w, 2, 2);
+  put_bits(w, 286 - 257, 5);
+  put_bits(w, 30 - 1, 5);
+  put_bits(w, hclen - 4, 4);
+  for (i = 0; i < hclen; i++) put_bits(w, clen[c_clen_order[i]], 3);
+  for (i = 0; i < 316; i++) put_code(w, ccode[all[i]], clen[all[i]]);
+  put_tokens(w, t, ntok, lcode, llen, dcode, dlen);
+}
+
+
+/**
+ * @brief Compress the bytes to a raw deflate stream of the block type.
+ *
+ * The compressed blocks are made every @a block_size input bytes; stored
+ * blocks are at most 65535 bytes.
+ */
+static void deflate(bytes_t *out, const byte_t *p, size_t n, btype_t bt,
+                    size_t block_size) {
+  bitw_t w;
+  size_t off = 0;
+
+  memset(&w, 0, sizeof(w));
+
+  if (bt == BT_STORED) {
+    do {
+      size_t m = (n - off < 65535) ? n - off : 65535;
+      put_bits(&w, off + m == n, 1);
+      put_bits(&w, 0, 2);
+      flush_bits(&w);
+      put_bits(&w, (unsigned long)m, 16);
+      put_bits(&w, (unsigned long)(~m & 0xffff), 16);
+      bytes_put(&w.out, &p[off], m);
+      off += m;
+    } while (off < n);
+  } else {
+    token_t *t;
+    size_t ntok;
+    t = lz77(p, n, &ntok, 1);
+    do {
+      // Split the tokens by the input bytes.
+      size_t k = 0, m = 0;
+      while (off + k < ntok && m < block_size) {
+        m += (t[off+k].dist == 0) ? 1 : t[off+k].len;
+        k++;
+      }
+      if (bt == BT_FIXED) {
+        put_fixed_block(&w, &t[off], k, off + k == ntok);
+      } else {
+        put_dynamic_block(&w, &t[off], k, off + k == ntok);
+      }
+      off += k;
+    } while (off < ntok);
+    free(t);
+  }
+
+  flush_bits(&w);
+  *out = w.out;
+}
+
+
+//-----------------------------------------------------------------------------
+// Zip Writer
+
+typedef struct zip_writer {
+  bytes_t data; // local headers and file data.
+  bytes_t cdir; // central directory.
+  unsigned long count;
+} zip_writer_t;
+
+
+static void zip_add(zip_writer_t *z, const char *fname, const byte_t *p,
+                    size_t n, int method, btype_t bt) {
+  unsigned long crc = gar_crc32(0, p, n);
+  unsigned long off = (unsigned long)z->data.len;
+  size_t nlen = strlen(fname);
+  bytes_t c = { NULL, 0, 0 };
+  const byte_t *q = p;
+  size_t m = n;
+
+  if (method == 8) {
+    deflate(&c, p, n, bt, 65536);
+    q = c.p;
+    m = c.len;
+  }
+
+  bytes_put_u32(&z->data, 0x04034b50);
+  bytes_put_u16(&z->data, 20);
+  bytes_put_u16(&z->data, 0);
+  bytes_put_u16(&z->data, method);
+  bytes_put_u32(&z->data, 0);
+  bytes_put_u32(&z->data, crc);
+  bytes_put_u32(&z->data, (unsigned long)m);
+  bytes_put_u32(&z->data, (unsigned long)n);
+  bytes_put_u16(&z->data, nlen);
+  bytes_put_u16(&z->data, 0);
+  bytes_put(&z->data, fname, nlen);
+  bytes_put(&z->data, q, m);
+
+  bytes_put_u32(&z->cdir, 0x02014b50);
+  bytes_put_u16(&z->cdir, 20);
+  bytes_put_u16(&z->cdir, 20);
+  bytes_put_u16(&z->cdir, 0);
+  bytes_put_u16(&z->cdir, method);
+  bytes_put_u32(&z->cdir, 0);
+  bytes_put_u32(&z->cdir, crc);
+  bytes_put_u32(&z->cdir, (unsigned long)m);
+  bytes_put_u32(&z->cdir, (unsigned long)n);
+  bytes_put_u16(&z->cdir, nlen);
+  bytes_put_u32(&z->cdir, 0);
+  bytes_put_u32(&z->cdir, 0);
+  bytes_put_u32(&z->cdir, 0);
+  bytes_put_u32(&z->cdir, off);
+  bytes_put(&z->cdir, fname, nlen);
+
+  z->count++;
+  free(c.p);
+}
+
+
+/// Finish the archive; the writer is reset.
+static void zip_finish(zip_writer_t *z, bytes_t *out) {
+  unsigned long cdir_off = (unsigned long)z->data.len;
+
+  bytes_put(&z->data, z->cdir.p, z->cdir.len);
+  bytes_put_u32(&z->data, 0x06054b50);
+  bytes_put_u32(&z->data, 0);
+  bytes_put_u16(&z->data, z->count);
+  bytes_put_u16(&z->data, z->count);
+  bytes_put_u32(&z->data, (unsigned long)z->cdir.len);
+  bytes_put_u32(&z->data, cdir_off);
+  bytes_put_u16(&z->data, 0);
+
+  *out = z->data;
+  free(z->cdir.p);
+  memset(z, 0, sizeof(*z));
+}
+
+
+//-----------------------------------------------------------------------------
+// Report
+
+static int s_json = 0;
+static int s_first = 1;
+
+
+static int compare_double(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+
+/**
+ * @brief Report the result of a benchmark.
+ *
+ * @param lat  latencies of the operations in seconds (sorted by this
+ * function), or NULL if they are not measured.
+ */
+static void report(const char *bench, const char *name, size_t ops,
+                   double bytes, double secs, double *lat) {
+  double p50 = 0, p90 = 0, p99 = 0, pmax = 0;
+  double mbps = (secs > 0) ? bytes / secs / 1e6 : 0;
+  double nsop = (ops > 0) ? secs / ops * 1e9 : 0;
+
+  if (lat != NULL && ops > 0) {
+    qsort(lat, ops, sizeof(double), &compare_double);
+    p50 = lat[ops * 50 / 100] * 1e6;
+    p90 = lat[ops * 90 / 100] * 1e6;
+    p99 = lat[ops * 99 / 100] * 1e6;
+    pmax = lat[ops - 1] * 1e6;
+  }
+
+  if (s_json) {
+    printf("%s\n  {\"benchmark\": \"%s\", \"case\": \"%s\", \"ops\": %lu, "
+           "\"bytes\": %.0f, \"seconds\": %.6f, \"mb_per_s\": %.2f, "
+           "\"ns_per_op\": %.1f, \"p50_us\": %.3f, \"p90_us\": %.3f, "
+           "\"p99_us\": %.3f, \"max_us\": %.3f}",
+           s_first ? "[" : ",", bench, name, (unsigned long)ops, bytes, secs,
+           mbps, nsop, p50, p90, p99, pmax);
+  } else {
+    if (s_first) {
+      printf("benchmark,case,ops,bytes,seconds,mb_per_s,ns_per_op,"
+             "p50_us,p90_us,p99_us,max_us\n");
+    }
+    printf("%s,%s,%lu,%.0f,%.6f,%.2f,%.1f,%.3f,%.3f,%.3f,%.3f\n",
+           bench, name, (unsigned long)ops, bytes, secs, mbps, nsop,
+           p50, p90, p99, pmax);
+  }
+  s_first = 0;
+  fflush(stdout);
+}
+
+
+static void report_end(void) {
+  if (s_json) printf("%s]\n", s_first ? "[" : "");
+}
+
+
+//-----------------------------------------------------------------------------
+// Benchmarks
+
+static int s_repeat = 5;
+static jmp_buf s_env;
+
+
+/// Time gar_open() + gar_close() of each zipped file in random order.
+static void bench_lookup(const char *name, const bytes_t *zip,
+                         char **fnames, size_t n) {
+  gar_t *G = gar_archive_open_memory(zip->p, zip->len, NULL, s_env);
+  size_t ops = n * s_repeat * 4;
+  double *lat = xmalloc(sizeof(double) * ops);
+  double t0, t1, total = 0;
+  gar_fstat_t fstat;
+  size_t i;
+
+  for (i = 0; i < ops; i++) {
+    const char *fname = fnames[rand_below(n)];
+    gar_fdata_t *fd;
+    t0 = now();
+    fd = gar_open(G, fname, s_env);
+    gar_close(fd);
+    t1 = now();
+    lat[i] = t1 - t0;
+    total += t1 - t0;
+  }
+  report("lookup", name, ops, 0, total, lat);
+
+  for (i = 0; i < ops; i++) {
+    const char *fname = fnames[rand_below(n)];
+    t0 = now();
+    gar_stat(G, fname, &fstat, s_env);
+    t1 = now();
+    lat[i] = t1 - t0;
+  }
+  total = 0;
+  for (i = 0; i < ops; i++) total += lat[i];
+  report("stat", name, ops, 0, total, lat);
+
+  free(lat);
+  gar_archive_close(G);
+}
+
+
+/// Time gar_read_all() and the stream reads of each zipped file.
+static void bench_extract(const char *name, const bytes_t *zip,
+                          char **fnames, size_t n) {
+  gar_t *G = gar_archive_open_memory(zip->p, zip->len, NULL, s_env);
+  size_t ops = n * s_repeat;
+  double *lat = xmalloc(sizeof(double) * ops);
+  double t0, t1, total = 0, bytes = 0;
+  static byte_t s[16384];
+  void *buf;
+  size_t i, len, m;
+  gar_fdata_t *fd;
+
+  for (i = 0; i < ops; i++) {
+    t0 = now();
+    gar_read_all(G, fnames[i % n], &buf, &len, s_env);
+    t1 = now();
+    gar_free(buf);
+    lat[i] = t1 - t0;
+    total += t1 - t0;
+    bytes += len;
+  }
+  report("read_all", name, ops, bytes, total, lat);
+
+  total = 0;
+  bytes = 0;
+  for (i = 0; i < ops; i++) {
+    t0 = now();
+    fd = gar_open(G, fnames[i % n], s_env);
+    while ((m = gar_read(fd, s, sizeof(s), s_env)) > 0) bytes += m;
+    gar_close(fd);
+    t1 = now();
+    lat[i] = t1 - t0;
+    total += t1 - t0;
+  }
+  report("read_stream", name, ops, bytes, total, lat);
+
+  free(lat);
+  gar_archive_close(G);
+}
+
+
+/// Time gar_read_all() of a zipped file decompressed by 4 threads in the chunks
+/// of 1MB, and check the data is the same as the serial one.
+static void bench_parallel(const char *name, const bytes_t *zip,
+                           const char *fname) {
+  gar_t *G = gar_archive_open_memory(zip->p, zip->len, NULL, s_env);
+  double *lat = xmalloc(sizeof(double) * s_repeat);
+  double t0, t1, total = 0, bytes = 0;
+  void *expected, *buf;
+  size_t expected_len, len;
+  int i;
+
+  gar_read_all(G, fname, &expected, &expected_len, s_env);
+  gar_set_parallel(G, 4, 1 << 20);
+  for (i = 0; i < s_repeat; i++) {
+    t0 = now();
+    gar_read_all(G, fname, &buf, &len, s_env);
+    t1 = now();
+    if (len != expected_len || memcmp(buf, expected, len) != 0) {
+      die("parallel decompression mismatch");
+    }
+    gar_free(buf);
+    lat[i] = t1 - t0;
+    total += t1 - t0;
+    bytes += len;
+  }
+  report("read_parallel", name, s_repeat, bytes, total, lat);
+
+  gar_free(expected);
+  free(lat);
+  gar_archive_close(G);
+}
+
+
+/// Time the stream reads of a zipped file from the archive file, by the input
+/// buffer sizes of gar_open_ex(), with the read-ahead and with the helper
+/// thread decompressing ahead.
+static void bench_read_file(const char *name, const bytes_t *zip,
+                            const char *fname) {
+  static const size_t bufsizes[] = { 1024, 32768, 262144, 32768, 32768 };
+  const int num_cases = sizeof(bufsizes) / sizeof(bufsizes[0]);
+  char path[] = "/tmp/garbenchXXXXXX";
+  int fd = mkstemp(path);
+  double *lat = xmalloc(sizeof(double) * s_repeat);
+  double t0, t1, total, bytes;
+  static byte_t s[16384];
+  char case_name[64];
+  gar_open_opts_t opts;
+  gar_fdata_t *fdata;
+  gar_t *G;
+  size_t m;
+  int i, k;
+
+  if (fd == -1 || write(fd, zip->p, zip->len) != (ssize_t)zip->len) {
+    die("cannot write a temporary file");
+  }
+  close(fd);
+  G = gar_archive_open_file(path, s_env);
+
+  for (k = 0; k < num_cases; k++) {
+    memset(&opts, 0, sizeof(opts));
+    opts.bufsize = bufsizes[k];
+    opts.readahead = (k == num_cases - 2) ? 4 << 20 : 0;
+    opts.async = (k == num_cases - 1) ? 4 : 0; // the last case.
+    total = 0;
+    bytes = 0;
+    for (i = 0; i < s_repeat; i++) {
+      t0 = now();
+      fdata = gar_open_ex(G, fname, &opts, s_env);
+      while ((m = gar_read(fdata, s, sizeof(s), s_env)) > 0) bytes += m;
+      gar_close(fdata);
+      t1 = now();
+      lat[i] = t1 - t0;
+      total += t1 - t0;
+    }
+    snprintf(case_name, sizeof(case_name), "%s-buf%luk%s%s", name,
+             (unsigned long)(bufsizes[k] >> 10),
+             (opts.readahead > 0) ? "-readahead" : "",
+             (opts.async > 0) ? "-async" : "");
+    report("read_file", case_name, s_repeat, bytes, total, lat);
+  }
+
+  gar_archive_close(G);
+  unlink(path);
+  free(lat);
+}
+
+
+/// Time the decompression of a raw deflate stream.
+static void bench_inflate(const char *bench, const char *name,
+                          const bytes_t *raw, size_t n) {
+  byte_t *out = xmalloc(n);
+  double *lat = xmalloc(sizeof(double) * s_repeat);
+  double t0, t1, total = 0;
+  gar_gfile_t gf;
+  int i;
+
+  for (i = 0; i < s_repeat; i++) {
+    t0 = now();
+    gar_gfile_open_memory(&gf, raw->p, raw->len, NULL, s_env);
+    if (gar_inflate_buffer(&gf, out, n, s_env) != n) die("size mismatch");
+    gar_gfile_close(&gf);
+    t1 = now();
+    lat[i] = t1 - t0;
+    total += t1 - t0;
+  }
+  report(bench, name, s_repeat, (double)n * s_repeat, total, lat);
+
+  free(lat);
+  free(out);
+}
+
+
+/// Time the decoding of each block type over the same data.
+static void bench_blocks(const char *name, const bytes_t *data) {
+  int bt;
+  char case_name[64];
+
+  for (bt = BT_STORED; bt <= BT_DYNAMIC; bt++) {
+    bytes_t raw = { NULL, 0, 0 };
+    deflate(&raw, data->p, data->len, (btype_t)bt, 65536);
+    snprintf(case_name, sizeof(case_name), "%s-%s", name, c_btype_name[bt]);
+    bench_inflate("block", case_name, &raw, data->len);
+    free(raw.p);
+  }
+}
+
+
+/**
+ * @brief Measure the decoding kernels by the crafted streams.
+ *
+ * - huffdic: many dynamic blocks of 4 literals, dominated by building the
+ *   lookup tables of each block header.
+ * - decode_huff: a dynamic block of the literals only.
+ * - expand_match: fixed blocks of the longest matches of each distance.
+ */
+static void bench_kernels(void) {
+  bytes_t data = { NULL, 0, 0 };
+  bitw_t w;
+  token_t *t;
+  size_t ntok, i, k;
+  char case_name[64];
+  static const int dists[] = { 1, 2, 3, 7, 8, 16, 64, 1024, 32768 };
+
+  // Build tables: a dynamic block per 4 literals.
+  make_text(&data, 4096 * 4);
+  memset(&w, 0, sizeof(w));
+  t = lz77(data.p, data.len, &ntok, 0);
+  for (i = 0; i < ntok; i += 4) {
+    put_dynamic_block(&w, &t[i], (ntok - i < 4) ? ntok - i : 4, i + 4 >= ntok);
+  }
+  flush_bits(&w);
+  free(t);
+  s_repeat *= 4;
+  bench_inflate("kernel", "huffdic-4096-blocks", &w.out, data.len);
+  s_repeat /= 4;
+  free(w.out.p);
+
+  // Decode literals: no match in a dynamic block.
+  data.len = 0;
+  make_text(&data, 8 << 20);
+  memset(&w, 0, sizeof(w));
+  t = lz77(data.p, data.len, &ntok, 0);
+  put_dynamic_block(&w, t, ntok, 1);
+  flush_bits(&w);
+  free(t);
+  bench_inflate("kernel", "decode_huff-literals", &w.out, data.len);
+  free(w.out.p);
+
+  // Expand matches: the longest matches of a distance after random bytes.
+  for (k = 0; k < sizeof(dists) / sizeof(dists[0]); k++) {
+    size_t n = 16 << 20;
+    size_t nmatch = (n - dists[k]) / 258;
+    data.len = 0;
+    make_random(&data, dists[k]);
+    t = xmalloc(sizeof(token_t) * (dists[k] + nmatch));
+    for (i = 0; i < (size_t)dists[k]; i++) {
+      t[i].len = data.p[i];
+      t[i].dist = 0;
+    }
+    for (i = 0; i < nmatch; i++) {
+      t[dists[k] + i].len = 258;
+      t[dists[k] + i].dist = (unsigned short)dists[k];
+    }
+    memset(&w, 0, sizeof(w));
+    put_fixed_block(&w, t, dists[k] + nmatch, 1);
+    flush_bits(&w);
+    free(t);
+    snprintf(case_name, sizeof(case_name), "expand_match-dist%d", dists[k]);
+    bench_inflate("kernel", case_name, &w.out, dists[k] + nmatch * 258);
+    free(w.out.p);
+  }
+
+  free(data.p);
+}
+
+
+/// Make an archive of a file, and benchmark the extraction.
+static void bench_file(const char *name, const bytes_t *data, int method,
+                       btype_t bt) {
+  zip_writer_t z;
+  bytes_t zip;
+  char *fname = (char *)name;
+
+  memset(&z, 0, sizeof(z));
+  zip_add(&z, name, data->p, data->len, method, bt);
+  zip_finish(&z, &zip);
+  bench_extract(name, &zip, &fname, 1);
+  if (method == 8) {
+    bench_parallel(name, &zip, fname);
+    bench_read_file(name, &zip, fname);
+  }
+  free(zip.p);
+}
+
+
+/// Make an archive of many tiny files, and benchmark the lookups and the
+/// extraction.
+static void bench_tiny(size_t n) {
+  zip_writer_t z;
+  bytes_t zip;
+  bytes_t data = { NULL, 0, 0 };
+  char **fnames = xmalloc(sizeof(char *) * n);
+  size_t i;
+
+  memset(&z, 0, sizeof(z));
+  for (i = 0; i < n; i++) {
+    fnames[i] = xmalloc(64);
+    snprintf(fnames[i], 64, "dir%03lu/file%06lu.txt", (unsigned long)(i / 100),
+             (unsigned long)i);
+    data.len = 0;
+    make_text(&data, 50 + rand_below(450));
+    zip_add(&z, fnames[i], data.p, data.len, 8, BT_FIXED);
+  }
+  zip_finish(&z, &zip);
+
+  bench_lookup("tiny", &zip, fnames, n);
+  bench_extract("tiny", &zip, fnames, n);
+
+  for (i = 0; i < n; i++) free(fnames[i]);
+  free(fnames);
+  free(data.p);
+  free(zip.p);
+}
+
+
+int main(int argc, char *argv[]) {
+  bytes_t text = { NULL, 0, 0 };
+  bytes_t binary = { NULL, 0, 0 };
+  bytes_t random = { NULL, 0, 0 };
+  size_t size = 8 << 20;
+  int i;
+
+  for (i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-j") == 0) {
+      s_json = 1;
+    } else if (strcmp(argv[i], "-S") == 0) {
+      gar_set_stats(NULL, 1); // measure the overhead of the statistics.
+    } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+      s_repeat = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+      size = (size_t)atol(argv[++i]) << 20;
+    } else {
+      fprintf(stderr, "synopsis: %s [-j] [-S] [-r repeat] [-s megabytes]\n",
+              argv[0]);
+      return argc != 1 && strcmp(argv[i], "-h") != 0;
+    }
+  }
+  if (s_repeat <= 0 || size == 0) die("invalid option");
+
+  if (setjmp(s_env)) {
+    return 1;
+  }
+
+  // Deterministic corpus.
+  make_text(&text, size);
+  make_binary(&binary, size);
+  make_random(&random, size / 4);
+
+  // End-to-end extraction of an archive.
+  bench_file("text", &text, 8, BT_DYNAMIC);
+  bench_file("binary", &binary, 8, BT_DYNAMIC);
+  bench_file("random", &random, 8, BT_STORED);
+  bench_file("text-stored", &text, 0, BT_STORED);
+  bench_tiny(5000);
+
+  // Decoding of each block type.
+  bench_blocks("text", &text);
+  bench_blocks("binary", &binary);
+
+  // Decoding kernels.
+  bench_kernels();
+
+  report_end();
+
+  free(text.p);
+  free(binary.p);
+  free(random.p);
+  return 0;
+}
@@ -0,0 +1,281 @@
+// garbig : make a sparse ZIP64 archive over 4GB to test the 64-bit offsets
+
+#define _FILE_OFFSET_BITS 64
+
+#include "gar.h"
+#include "garlib.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+
+#define num_many 70000 // more than 65535 entries.
+#define num_entries (3 + num_many)
+#define max_u32 0xffffffffULL
+
+/// Number of the zeros of sparse.bin and zeros.bin, over 4GB; zeros.bin is a
+/// literal and 16647170 matches of 258 bytes.
+static const gar_off_t c_zeros = 1 + 258 * 16647170ULL;
+static const char c_sparse_end[] = "sparse file end\n";
+static const char c_tail[] = "tail of the big archive\n";
+
+
+typedef struct entry {
+  char fname[16];
+  unsigned method;
+  unsigned long crc32;
+  gar_off_t comp_size;
+  gar_off_t uncomp_size;
+  gar_off_t hdr_off;
+} entry_t;
+
+
+static FILE *s_fp;
+static const char *s_fname;
+static entry_t s_entries[num_entries];
+static unsigned long s_bits; // bits not written yet.
+static int s_nbits;
+
+
+static void die(const char *msg) {
+  fprintf(stderr, "%s: %s\n", s_fname, msg);
+  exit(1);
+}
+
+
+static void put(const void *p, size_t n) {
+  if (fwrite(p, 1, n, s_fp) < n) die("write error");
+}
+
+
+static void put_u16(unsigned long x) {
+  unsigned char s[2];
+  s[0] = x & 0xff;
+  s[1] = (x >> 8) & 0xff;
+  put(s, 2);
+}
+
+
+static void put_u32(unsigned long x) {
+  put_u16(x & 0xffff);
+  put_u16((x >> 16) & 0xffff);
+}
+
+
+static void put_u64(gar_off_t x) {
+  put_u32((unsigned long)(x & max_u32));
+  put_u32((unsigned long)(x >> 32));
+}
+
+
+static gar_off_t tell(void) {
+  off_t off = ftello(s_fp);
+  if (off == -1) die("tell error");
+  return (gar_off_t)off;
+}
+
+
+/// Write a Huffman code, whose bits are packed from the most significant one.
+static void put_code(unsigned long code, int len) {
+  while (len-- > 0) {
+    s_bits |= ((code >> len) & 1) << s_nbits;
+    if (++s_nbits == 8) {
+      if (putc((int)s_bits, s_fp) == EOF) die("write error");
+      s_bits = 0;
+      s_nbits = 0;
+    }
+  }
+}
+
+
+/// CRC-32 of the given number of zeros.
+static unsigned long crc32_zeros(gar_off_t n) {
+  static const unsigned char zeros[65536];
+  unsigned long crc = 0;
+  while (n > 0) {
+    size_t m = (n < sizeof(zeros)) ? (size_t)n : sizeof(zeros);
+    crc = gar_crc32(crc, zeros, m);
+    n -= m;
+  }
+  return crc;
+}
+
+
+/// Write a local file header; both the sizes are in the ZIP64 extra field if
+/// either of them does not fit in 32 bits.
+static void put_local(entry_t *e) {
+  int zip64 = e->comp_size >= max_u32 || e->uncomp_size >= max_u32;
+
+  e->hdr_off = tell();
+  put_u32(0x04034b50);
+  put_u16(zip64 ? 45 : 20);
+  put_u16(0); // flags.
+  put_u16(e->method);
+  put_u16(0); // 00:00:00.
+  put_u16(0x21); // 1980-01-01.
+  put_u32(e->crc32);
+  put_u32(zip64 ? max_u32 : e->comp_size);
+  put_u32(zip64 ? max_u32 : e->uncomp_size);
+  put_u16(strlen(e->fname));
+  put_u16(zip64 ? 20 : 0);
+  put(e->fname, strlen(e->fname));
+  if (zip64) {
+    put_u16(0x0001);
+    put_u16(16);
+    put_u64(e->uncomp_size);
+    put_u64(e->comp_size);
+  }
+}
+
+
+/// Write a central directory file header; each of the values not fitting in
+/// 32 bits is in the ZIP64 extra field.
+static void put_central(const entry_t *e) {
+  int big_uncomp = e->uncomp_size >= max_u32;
+  int big_comp = e->comp_size >= max_u32;
+  int big_off = e->hdr_off >= max_u32;
+  int n = (big_uncomp + big_comp + big_off) * 8;
+
+  put_u32(0x02014b50);
+  put_u16(45);
+  put_u16(n > 0 ? 45 : 20);
+  put_u16(0); // flags.
+  put_u16(e->method);
+  put_u16(0); // 00:00:00.
+  put_u16(0x21); // 1980-01-01.
+  put_u32(e->crc32);
+  put_u32(big_comp ? max_u32 : e->comp_size);
+  put_u32(big_uncomp ? max_u32 : e->uncomp_size);
+  put_u16(strlen(e->fname));
+  put_u16(n > 0 ? 4 + n : 0);
+  put_u16(0); // comment.
+  put_u16(0); // disk.
+  put_u16(0); // internal attributes.
+  put_u32(0); // external attributes.
+  put_u32(big_off ? max_u32 : e->hdr_off);
+  put(e->fname, strlen(e->fname));
+  if (n > 0) {
+    put_u16(0x0001);
+    put_u16(n);
+    if (big_uncomp) put_u64(e->uncomp_size);
+    if (big_comp) put_u64(e->comp_size);
+    if (big_off) put_u64(e->hdr_off);
+  }
+}
+
+
+/// Write the stored entry of which the zeros are a hole of the file.
+static void put_sparse(entry_t *e, unsigned long crc_zeros) {
+  strcpy(e->fname, "sparse.bin");
+  e->method = 0;
+  e->crc32 = gar_crc32(crc_zeros, c_sparse_end, strlen(c_sparse_end));
+  e->uncomp_size = e->comp_size = c_zeros + strlen(c_sparse_end);
+  put_local(e);
+  if (fseeko(s_fp, (off_t)c_zeros, SEEK_CUR)) die("seek error");
+  put(c_sparse_end, strlen(c_sparse_end));
+}
+
+
+/// Write the deflated entry of the zeros, by a fixed Huffman block.
+static void put_zeros(entry_t *e, unsigned long crc_zeros) {
+  const gar_off_t nbits = 3 + 8 + (c_zeros - 1) / 258 * 13 + 7;
+  gar_off_t i;
+
+  strcpy(e->fname, "zeros.bin");
+  e->method = 8;
+  e->crc32 = crc_zeros;
+  e->uncomp_size = c_zeros;
+  e->comp_size = (nbits + 7) / 8;
+  put_local(e);
+
+  put_code(6, 3); // BFINAL=1 and BTYPE=01, in the order of the bits.
+  put_code(0x30, 8); // literal 0.
+  for (i = 0; i < (c_zeros - 1) / 258; i++) {
+    put_code(0xc5, 8); // length 258.
+    put_code(0, 5); // distance 1.
+  }
+  put_code(0, 7); // end of block.
+  if (s_nbits > 0) put_code(0, 8 - s_nbits); // padding.
+}
+
+
+static void put_stored(entry_t *e, const char *fname, const void *p,
+                       size_t n) {
+  strcpy(e->fname, fname);
+  e->method = 0;
+  e->crc32 = gar_crc32(0, p, n);
+  e->uncomp_size = e->comp_size = n;
+  put_local(e);
+  put(p, n);
+}
+
+
+int main(int argc, char *argv[]) {
+  unsigned long crc_zeros;
+  gar_off_t cd_off;
+  gar_off_t eocd_off;
+  char fname[16];
+  char data[16];
+  int i;
+
+  if (argc != 2) {
+    fprintf(stderr, "synopsis: %s zip-file\n", argv[0]);
+    return 1;
+  }
+  s_fname = argv[1];
+  if ((s_fp = fopen(s_fname, "wb")) == NULL) die("cannot open");
+
+  // Write the zipped files; the ones but the first are beyond 4GB.
+  crc_zeros = crc32_zeros(c_zeros);
+  put_sparse(&s_entries[0], crc_zeros);
+  put_zeros(&s_entries[1], crc_zeros);
+  put_stored(&s_entries[2], "tail.txt", c_tail, strlen(c_tail));
+  for (i = 0; i < num_many; i++) {
+    sprintf(fname, "many/%05d", i);
+    sprintf(data, "%d\n", i);
+    put_stored(&s_entries[3 + i], fname, data, strlen(data));
+  }
+
+  // Write the central directory.
+  cd_off = tell();
+  for (i = 0; i < num_entries; i++) {
+    put_central(&s_entries[i]);
+  }
+
+  // Write the ZIP64 end of central directory record and its locator.
+  eocd_off = tell();
+  put_u32(0x06064b50);
+  put_u64(44);
+  put_u16(45);
+  put_u16(45);
+  put_u32(0);
+  put_u32(0);
+  put_u64(num_entries);
+  put_u64(num_entries);
+  put_u64(eocd_off - cd_off);
+  put_u64(cd_off);
+  put_u32(0x07064b50);
+  put_u32(0);
+  put_u64(eocd_off);
+  put_u32(1);
+
+  // Write the end of central directory record, whose values are saturated.
+  put_u32(0x06054b50);
+  put_u16(0);
+  put_u16(0);
+  put_u16(0xffff);
+  put_u16(0xffff);
+  put_u32(max_u32);
+  put_u32(max_u32);
+  put_u16(0);
+
+  if (fclose(s_fp)) die("write error");
+
+  // Print the list of the zipped files.
+  for (i = 0; i < num_entries; i++) {
+    printf("%s\n", s_entries[i].fname);
+  }
+
+  return 0;
+}
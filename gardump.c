@@ -1,7 +1,67 @@
 // gardump : list/dump zipped files
 
 #include "gar.h"
+#include "garlib.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/// Open an archive via the C runtime's stdio.
+static gar_t *open_stdio(const char *fname, jmp_buf _env) {
+  jmp_buf env;
+  gar_gfile_t gf;
+  gar_gfile_null(&gf);
+
+  if (setjmp(env)) {
+    gar_gfile_close(&gf);
+    longjmp(_env, 1);
+  }
+
+  gar_gfile_open_file(&gf, fname, env);
+  return gar_archive_gopen(&gf, env);
+}
+
+
+/// Release the archive read by open_memory().
+static void release_memory(void *ptr, size_t len) {
+  ((void)len);
+  free(ptr);
+}
+
+
+/// Open an archive read onto memory at once.
+static gar_t *open_memory(const char *fname, jmp_buf env) {
+  FILE *fp = fopen(fname, "rb");
+  char *ptr = NULL;
+  size_t len = 0;
+  size_t cap = 0;
+  size_t n;
+
+  if (fp == NULL) {
+    fprintf(stderr, "%s: cannot open\n", fname);
+    longjmp(env, 1);
+  }
+  do {
+    if (len == cap) {
+      char *p = realloc(ptr, (cap > 0) ? cap * 2 : 65536);
+      if (p == NULL) {
+        fclose(fp);
+        free(ptr);
+        fprintf(stderr, "%s: out of memory\n", fname);
+        longjmp(env, 1);
+      }
+      ptr = p;
+      cap = (cap > 0) ? cap * 2 : 65536;
+    }
+    n = fread(ptr + len, 1, cap - len, fp);
+    len += n;
+  } while (n > 0);
+  fclose(fp);
+
+  // The buffer is freed by the archive, even if it fails to open.
+  return gar_archive_open_memory(ptr, len, &release_memory, env);
+}
 
 
 static int on_list(const gar_fstat_t *fstat, void *ud, jmp_buf env) {
@@ -12,6 +72,33 @@ static int on_list(const gar_fstat_t *fstat, void *ud, jmp_buf env) {
 }
 
 
+/// List a zipped file by the name view.
+static int on_list_name(const gar_entry_stat_t *st, void *ud, jmp_buf env) {
+  ((void)ud);
+  ((void)env);
+  printf("%.*s\n", (int)st->name_len, st->name);
+  return 0; // continue enumeration.
+}
+
+
+/// List a zipped file with its metadata, separated by tabs.
+static int on_list_long(const gar_entry_stat_t *st, void *ud, jmp_buf env) {
+  ((void)ud);
+  ((void)env);
+  printf("%u\t%llu\t%llu\t%08lx\t"
+         "%04lu-%02lu-%02lu %02lu:%02lu:%02lu\t%.*s\n",
+         st->method, st->comp_size, st->fsize, st->crc32,
+         (st->mtime >> 25) + 1980, (st->mtime >> 21) & 15,
+         (st->mtime >> 16) & 31, (st->mtime >> 11) & 31,
+         (st->mtime >> 5) & 63, (st->mtime & 31) * 2,
+         (int)st->name_len, st->name);
+  return 0; // continue enumeration.
+}
+
+
+static gar_open_opts_t s_opts; // the options given by the -b/-r/-t options.
+
+
 static int dump_file(gar_t *G, const char *fname) {
   jmp_buf env;
   gar_fdata_t *volatile fd = NULL;
@@ -25,7 +112,7 @@ static int dump_file(gar_t *G, const char *fname) {
   }
 
   // Open the specified zipped file.
-  fd = gar_open(G, fname, env);
+  fd = gar_open_ex(G, fname, &s_opts, env);
   if (fd == NULL) {
     fprintf(stderr, "%s: no such file\n", fname);
     longjmp(env, 1);
@@ -43,17 +130,363 @@ static int dump_file(gar_t *G, const char *fname) {
 }
 
 
+static gar_off_t s_offset = 0; // the offset given by the -o option.
+static gar_off_t s_span = 1048576; // the span given by the -x option.
+static int s_reload = 0; // nonzero if the -X option is given.
+static int s_threads = 1; // the threads given by the -j option.
+static gar_off_t s_chunk = 0; // the chunk size given by the -c option.
+static const char *s_prefix = NULL; // the prefix given by the -P option.
+static const char *s_dir = NULL; // the directory given by the -d option.
+
+
+/// Index saved onto memory by gar_zindex_save().
+typedef struct saved {
+  unsigned char *ptr;
+  size_t len;
+} saved_t;
+
+
+static void on_save(void *ud, const void *ptr, size_t n, jmp_buf env) {
+  saved_t *s = (saved_t *)ud;
+  unsigned char *p = realloc(s->ptr, s->len + n);
+  if (p == NULL) {
+    fprintf(stderr, "out of memory\n");
+    longjmp(env, 1);
+  }
+  memcpy(p + s->len, ptr, n);
+  s->ptr = p;
+  s->len += n;
+}
+
+
+/// Save the index onto memory and load it back; @a X is closed.
+static gar_zindex_t *reload_index(gar_zindex_t *X, jmp_buf _env) {
+  jmp_buf env;
+  saved_t s;
+  gar_gfile_t gf;
+  gar_zindex_t *Y;
+  s.ptr = NULL;
+  s.len = 0;
+  gar_gfile_null(&gf);
+
+  if (setjmp(env)) {
+    gar_gfile_close(&gf);
+    free(s.ptr);
+    gar_zindex_close(X);
+    longjmp(_env, 1);
+  }
+
+  gar_zindex_save(X, &on_save, &s, env);
+  gar_gfile_open_memory(&gf, s.ptr, s.len, NULL, env);
+  Y = gar_zindex_load(&gf, env);
+  gar_gfile_close(&gf);
+  free(s.ptr);
+
+  gar_zindex_close(X);
+  return Y;
+}
+
+
+static int dump_file_at(gar_t *G, const char *fname) {
+  jmp_buf env;
+  gar_zindex_t *volatile X = NULL;
+  gar_fdata_t *volatile fd = NULL;
+  gar_open_opts_t opts = s_opts;
+  unsigned char s[1024];
+  size_t n;
+
+  // Make sure to close the zipped file stream and the index.
+  if (setjmp(env)) {
+    gar_close(fd);
+    gar_zindex_close(X);
+    return 1;
+  }
+
+  // Index the specified zipped file and open it with the index.
+  X = gar_zindex_build(G, fname, s_span, env);
+  if (X == NULL) {
+    fprintf(stderr, "%s: no such file\n", fname);
+    longjmp(env, 1);
+  }
+  if (s_reload) {
+    gar_zindex_t *Y = X;
+    X = NULL; // closed by reload_index() even if it fails.
+    X = reload_index(Y, env);
+  }
+  opts.index = X;
+  fd = gar_open_ex(G, fname, &opts, env);
+
+  // Print the zipped file data after the offset to stdout.
+  gar_seek(fd, s_offset, env);
+  while ((n = gar_read(fd, s, sizeof(s), env)) > 0) {
+    fwrite(s, 1, n, stdout);
+  }
+
+  gar_close(fd);
+  gar_zindex_close(X);
+
+  return 0;
+}
+
+
+static int dump_file_all(gar_t *G, const char *fname) {
+  jmp_buf env;
+  void *volatile buf = NULL;
+  size_t n;
+
+  // Make sure to free the data.
+  if (setjmp(env)) {
+    gar_free(buf);
+    return 1;
+  }
+
+  // Read the whole data of the specified zipped file at once.
+  if (!gar_read_all(G, fname, (void **)&buf, &n, env)) {
+    fprintf(stderr, "%s: no such file\n", fname);
+    longjmp(env, 1);
+  }
+
+  // Print it to stdout.
+  fwrite(buf, 1, n, stdout);
+  gar_free(buf);
+
+  return 0;
+}
+
+
+/// Zipped files' data extracted in parallel.
+typedef struct extracted {
+  char *const *fnames;
+  int num;
+  char **data;
+  size_t *len;
+} extracted_t;
+
+
+static int on_extract(const gar_fstat_t *fstat, const void *ptr, void *ud,
+                      jmp_buf env) {
+  extracted_t *x = (extracted_t *)ud;
+  int i;
+
+  // Find the slot by the name pointer given to gar_extract_many().
+  for (i = 0; x->fnames[i] != fstat->fname; i++) {
+  }
+
+  // Keep a copy of the data to print the files in the given order.
+  // The size fits in size_t, since the data is on memory.
+  x->len[i] = (size_t)fstat->fsize;
+  x->data[i] = malloc(x->len[i] > 0 ? x->len[i] : 1);
+  if (x->data[i] == NULL) {
+    fprintf(stderr, "%s: out of memory\n", fstat->fname);
+    longjmp(env, 1);
+  }
+  memcpy(x->data[i], ptr, x->len[i]);
+  return 0; // continue extraction.
+}
+
+
+static int dump_files_parallel(gar_t *G, char *const fnames[], int num) {
+  jmp_buf env;
+  extracted_t x;
+  int i;
+
+  x.fnames = fnames;
+  x.num = num;
+  x.data = calloc(num, sizeof(char *));
+  x.len = calloc(num, sizeof(size_t));
+
+  // Make sure to free the data.
+  if (setjmp(env) || x.data == NULL || x.len == NULL) {
+    for (i = 0; x.data != NULL && i < num; i++) free(x.data[i]);
+    free(x.data);
+    free(x.len);
+    return 1;
+  }
+
+  // Extract the zipped files by all the processors.
+  gar_extract_many(G, (const char *const *)fnames, num, &on_extract, &x, 0,
+                   env);
+
+  // Print them to stdout in the given order.
+  for (i = 0; i < num; i++) {
+    fwrite(x.data[i], 1, x.len[i], stdout);
+    free(x.data[i]);
+  }
+  free(x.data);
+  free(x.len);
+
+  return 0;
+}
+
+
+/// Read the archive forward from stdin; list all the zipped files, or print
+/// the specified ones in the archive order.
+static int dump_stream(char *const fnames[], int num) {
+  jmp_buf env;
+  gar_stream_t *volatile S = NULL;
+  gar_gfile_t gf;
+  gar_fstat_t fstat;
+  unsigned char s[1024];
+  size_t n;
+  int i;
+  gar_gfile_null(&gf);
+
+  // Make sure to close the stream.
+  if (setjmp(env)) {
+    gar_gfile_close(&gf);
+    gar_stream_close(S);
+    return 1;
+  }
+
+  gar_gfile_open_fp(&gf, stdin, "(stdin)", env);
+  if (s_opts.async > 0) gar_gfile_open_async(&gf, s_opts.async, env);
+  S = gar_stream_gopen(&gf, env);
+
+  while (gar_stream_next(S, &fstat, env)) {
+    if (num == 0) {
+      printf("%s\n", fstat.fname);
+      continue;
+    }
+    for (i = 0; i < num; i++) {
+      if (strcmp(fnames[i], fstat.fname) == 0) break;
+    }
+    if (i < num) {
+      while ((n = gar_stream_read(S, s, sizeof(s), env)) > 0) {
+        fwrite(s, 1, n, stdout);
+      }
+    }
+  }
+
+  gar_stream_close(S);
+  return 0;
+}
+
+
+/// Print the statistics of the archive to stderr.
+static void print_stats(const gar_t *G) {
+  static const char *const stages[GAR_NUM_STAGES] = {
+    "lookup", "header", "io", "inflate", "table", "crc",
+  };
+  gar_stats_t S;
+  int i;
+
+  gar_get_stats(G, &S);
+  fprintf(stderr, "reads: %llu calls, %llu bytes; seeks: %llu; headers: %llu\n",
+          S.read_calls, S.read_bytes, S.seeks, S.headers);
+  fprintf(stderr, "blocks: %llu stored, %llu fixed, %llu dynamic; "
+          "tables: %llu\n", S.blocks[0], S.blocks[1], S.blocks[2], S.tables);
+  fprintf(stderr, "symbols: %llu literals, %llu matches; output: %llu bytes\n",
+          S.literals, S.matches, S.out_bytes);
+  for (i = 0; i < GAR_NUM_STAGES; i++) {
+    fprintf(stderr, "%s%s: %.3f ms", (i > 0) ? ", " : "time: ", stages[i],
+            S.ns[i] / 1e6);
+  }
+  fprintf(stderr, "\n");
+}
+
+
 int main(int argc, char *argv[]) {
   gar_t *volatile G = NULL;
+  gar_t *(*open_fn)(const char *, jmp_buf) = &gar_archive_open_file;
+  int (*dump_fn)(gar_t *, const char *) = &dump_file;
+  int parallel = 0;
+  int stats = 0;
+  int list_long = 0;
   jmp_buf env;
   int i;
 
+  // Map the zip archive onto memory if the -m option is given, read it onto
+  // memory at once if the -M option is given, or read it via stdio if the -s
+  // option is given. Read each zipped file at once if the -a option is given,
+  // or extract all of them in parallel if the -p option is given. Print each
+  // zipped file after the offset if the -o option is given, by the index of the
+  // access points every span bytes of the -x option, saved and loaded back if
+  // the -X option is given; and the statistics to stderr if the -S option is
+  // given. List the zipped files with the method, the sizes, the CRC-32 and the
+  // modification time if the -l option is given, only those whose names begin
+  // with the prefix of the -P option, or just in the directory of the -d
+  // option. Read the compressed data by the bytes of the -b option at once, and
+  // ahead by the bytes of the -r option. Decompress the chunks of the -t option
+  // ahead by a helper thread. Decompress each large file read at once by the
+  // threads of the -j option, in the chunks of the compressed bytes of the -c
+  // option. Read the archive forward from stdin if the zip-file is "-", ahead
+  // by the chunks of the -t option.
+  while (argc > 2 && (strcmp(argv[1], "-o") == 0 ||
+                      strcmp(argv[1], "-b") == 0 ||
+                      strcmp(argv[1], "-r") == 0 ||
+                      strcmp(argv[1], "-t") == 0 ||
+                      strcmp(argv[1], "-j") == 0 ||
+                      strcmp(argv[1], "-c") == 0 ||
+                      strcmp(argv[1], "-x") == 0 ||
+                      strcmp(argv[1], "-P") == 0 ||
+                      strcmp(argv[1], "-d") == 0)) {
+    if (argv[1][1] == 'P') {
+      s_prefix = argv[2];
+    } else if (argv[1][1] == 'd') {
+      s_dir = argv[2];
+    } else if (argv[1][1] == 'x') {
+      s_span = strtoull(argv[2], NULL, 10);
+    } else if (argv[1][1] == 'j') {
+      s_threads = atoi(argv[2]);
+    } else if (argv[1][1] == 'c') {
+      s_chunk = strtoull(argv[2], NULL, 10);
+    } else if (argv[1][1] == 'b') {
+      s_opts.bufsize = (size_t)strtoul(argv[2], NULL, 10);
+    } else if (argv[1][1] == 't') {
+      s_opts.async = (size_t)strtoul(argv[2], NULL, 10);
+    } else if (argv[1][1] == 'r') {
+      s_opts.readahead = strtoull(argv[2], NULL, 10);
+    } else {
+      s_offset = strtoull(argv[2], NULL, 10);
+      dump_fn = &dump_file_at;
+    }
+    argv[2] = argv[0];
+    argc -= 2;
+    argv += 2;
+  }
+  while (argc > 1 && (strcmp(argv[1], "-m") == 0 ||
+                      strcmp(argv[1], "-M") == 0 ||
+                      strcmp(argv[1], "-s") == 0 ||
+                      strcmp(argv[1], "-a") == 0 ||
+                      strcmp(argv[1], "-p") == 0 ||
+                      strcmp(argv[1], "-S") == 0 ||
+                      strcmp(argv[1], "-l") == 0 ||
+                      strcmp(argv[1], "-X") == 0)) {
+    if (argv[1][1] == 'S') {
+      stats = 1;
+    } else if (argv[1][1] == 'l') {
+      list_long = 1;
+    } else if (argv[1][1] == 'X') {
+      s_reload = 1;
+    } else if (argv[1][1] == 'a') {
+      dump_fn = &dump_file_all;
+    } else if (argv[1][1] == 'p') {
+      parallel = 1;
+    } else if (argv[1][1] == 'M') {
+      open_fn = &open_memory;
+    } else {
+      open_fn = (argv[1][1] == 'm') ? &gar_archive_open_mmap : &open_stdio;
+    }
+    argv[1] = argv[0];
+    argc--;
+    argv++;
+  }
+
   // If no argument is given, display the usage and exit in success.
   if (argc == 1) {
-    fprintf(stderr, "synopsis: %s zip-file [zipped-files ...]\n", argv[0]);
+    fprintf(stderr,
+            "synopsis: %s [-o offset [-x span] [-X]] [-b bufsize]"
+            " [-r readahead] [-t chunks] [-j threads] [-c chunk]"
+            " [-P prefix|-d dir] [-m|-M|-s] [-a|-p] [-S] [-l] zip-file"
+            " [zipped-files ...]\n",
+            argv[0]);
     return 0;
   }
 
+  if (strcmp(argv[1], "-") == 0) {
+    return dump_stream(&argv[2], argc - 2);
+  }
+
   // Make sure to close the zip archive.
   if (setjmp(env)) {
     gar_archive_close(G);
@@ -61,20 +494,37 @@ int main(int argc, char *argv[]) {
   }
 
   // Open the specified zip archive.
-  G = gar_archive_open_file(argv[1], env);
+  gar_set_stats(NULL, stats);
+  G = (*open_fn)(argv[1], env);
+  gar_set_parallel(G, s_threads, s_chunk);
 
   if (argc == 2) {
     // If only a zip file name is given, list all the zipped files.
-    gar_enum(G, &on_list, NULL, env);
+    gar_enum_ex_t fn = list_long ? &on_list_long : &on_list_name;
+    if (s_prefix != NULL) {
+      gar_enum_prefix(G, s_prefix, fn, NULL, env);
+    } else if (s_dir != NULL) {
+      gar_list_dir(G, s_dir, fn, NULL, env);
+    } else if (list_long) {
+      gar_enum_ex(G, fn, NULL, env);
+    } else {
+      gar_enum(G, &on_list, NULL, env);
+    }
+  } else if (parallel) {
+    if (dump_files_parallel(G, &argv[2], argc - 2)) {
+      longjmp(env, 1);
+    }
   } else {
     // Otherwise, print the data of the specified zipped file(s) to stdout.
     for (i = 2; i < argc; i++) {
-      if (dump_file(G, argv[i])) { // returns nonzero at error.
+      if ((*dump_fn)(G, argv[i])) { // returns nonzero at error.
         longjmp(env, 1);
       }
     }
   }
 
+  if (stats) print_stats(G);
+
   // Close the archive.
   gar_archive_close(G);
 
@@ -4,8 +4,15 @@
 #include <stdio.h>
 
 
+/// Nonzero while the calling thread raises the errors which are expected and
+/// handled, e.g. by the speculative decompression.
+__thread int _gar_silent = 0;
+
+
 void _gar_error(jmp_buf env, const char *pre, const char *msg) {
-  if (pre != NULL) {
+  if (_gar_silent) {
+    // Not displayed.
+  } else if (pre != NULL) {
     fprintf(stderr, "%s: %s\n", pre, msg);
   } else {
     fprintf(stderr, "%s\n", msg);
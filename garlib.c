@@ -3,14 +3,57 @@
 #include "gar.h"
 #include "garlib.h"
 #include "garaux.h"
+#include <pthread.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+
+
+typedef unsigned char byte_t;
+typedef unsigned long u32_t;
+typedef unsigned short u16_t;
+
+
+/// Status of a zipped file, indexed on opening the archive.
+typedef struct gar_entry {
+  size_t fname_off; ///< Offset of the file name in gar_t::names.
+  size_t hash; ///< Hash value of the file name.
+  u16_t fname_len;
+  u16_t comp_method;
+  u32_t crc32;
+  u32_t mtime; ///< MS-DOS date and time of the last modification.
+  gar_off_t comp_size;
+  gar_off_t uncomp_size;
+  gar_off_t hdr_off; ///< Offset of the PK0304 chunk (local file header).
+} gar_entry_t;
 
 
 struct gar {
   gar_gfile_t gf;
+  gar_entry_t *entries; ///< Zipped files' status in the directory order.
+  size_t num_entries;
+  size_t entries_cap;
+  char *names; ///< Pool of the NUL-terminated file names.
+  size_t names_len;
+  size_t names_cap;
+  size_t *hash; ///< Hash table of (index of entries[] + 1), or 0 if empty.
+  size_t hash_mask;
+  size_t *sorted; ///< Indices of entries[] sorted by the file name.
+  int verify; ///< Verify CRC-32 of the zipped files opened afterward.
+  int nthreads; ///< Threads to decompress a large file (see gar_set_parallel()).
+  gar_off_t chunk; ///< Compressed bytes per thread at least.
+  gar_ipool_t *pool; ///< Pool of the decompressors.
+  const gar_allocator_t *alloc; ///< Allocator of the zipped files, or NULL.
+  gar_counters_t *counters; ///< Statistics (see gar_set_stats()).
 };
 
 
+#define default_chunk ((gar_off_t)4 << 20) // see gar_set_parallel().
+
+
+static void build_index(gar_t *G, jmp_buf env);
+
+
 /// Open the specified (generalized) file as an archive.
 gar_t *gar_archive_gopen(gar_gfile_t *gf, jmp_buf _env) {
   jmp_buf env;
@@ -24,8 +67,29 @@ gar_t *gar_archive_gopen(gar_gfile_t *gf, jmp_buf _env) {
   // Allocate a new gar_t instance and move the specified file onto it.
   G = _gar_malloc(sizeof(gar_t), env);
   G->gf = *gf;
+  G->entries = NULL;
+  G->num_entries = 0;
+  G->entries_cap = 0;
+  G->names = NULL;
+  G->names_len = 0;
+  G->names_cap = 0;
+  G->hash = NULL;
+  G->hash_mask = 0;
+  G->sorted = NULL;
+  G->verify = 1;
+  G->nthreads = 1;
+  G->chunk = default_chunk;
+  G->pool = NULL;
+  G->alloc = NULL;
+  G->counters = NULL;
   gar_gfile_null(gf); // get the ownership.
 
+  G->pool = _gar_ipool_new(_gar_global_allocator(), env);
+  G->counters = _gar_counters_new(env);
+
+  // Index all the zipped files.
+  build_index(G, env);
+
   return G;
 }
 
@@ -34,16 +98,17 @@ gar_t *gar_archive_gopen(gar_gfile_t *gf, jmp_buf _env) {
 void gar_archive_close(gar_t *G) {
   if (G != NULL) {
     gar_gfile_close(&G->gf);
+    _gar_ipool_release(G->pool);
+    _gar_counters_release(G->counters);
+    _gar_free(G->entries);
+    _gar_free(G->names);
+    _gar_free(G->hash);
+    _gar_free(G->sorted);
     _gar_free(G);
   }
 }
 
 
-typedef unsigned char byte_t;
-typedef unsigned long u32_t;
-typedef unsigned short u16_t;
-
-
 typedef struct pk0304_header {
   u32_t sig;
   u16_t need_ver;
@@ -59,6 +124,71 @@ typedef struct pk0304_header {
 } pk0304_header_t;
 
 
+typedef struct pk0102_header {
+  u32_t sig;
+  u16_t made_ver;
+  u16_t need_ver;
+  u16_t flags;
+  u16_t comp_method;
+  u16_t last_mod_time;
+  u16_t last_mod_date;
+  u32_t crc32;
+  u32_t comp_size;
+  u32_t uncomp_size;
+  u16_t fname_len;
+  u16_t extra_len;
+  u16_t comment_len;
+  u16_t disk_start;
+  u16_t int_attr;
+  u32_t ext_attr;
+  u32_t hdr_off;
+} pk0102_header_t;
+
+
+typedef struct pk0506_header {
+  u32_t sig;
+  u16_t disk;
+  u16_t cd_disk;
+  u16_t disk_entries;
+  u16_t total_entries;
+  u32_t cd_size;
+  u32_t cd_off;
+  u16_t comment_len;
+} pk0506_header_t;
+
+
+typedef struct pk0606_header {
+  u32_t sig;
+  gar_off_t rec_size;
+  u16_t made_ver;
+  u16_t need_ver;
+  u32_t disk;
+  u32_t cd_disk;
+  gar_off_t disk_entries;
+  gar_off_t total_entries;
+  gar_off_t cd_size;
+  gar_off_t cd_off;
+} pk0606_header_t;
+
+
+typedef struct pk0607_header {
+  u32_t sig;
+  u32_t eocd_disk;
+  gar_off_t eocd_off;
+  u32_t total_disks;
+} pk0607_header_t;
+
+
+/// Decode an unsigned integer of 64bits in little endian.
+static void decode_u64_le(const byte_t s[8], gar_off_t *t) {
+  int i;
+  *t = 0;
+  for (i = 7; i >= 0; i--) {
+    *t = (*t << 8) | s[i];
+  }
+}
+
+
 /// Decode an unsigned integer of 32bits in little endian.
 static void decode_u32_le(const byte_t s[4], u32_t *t) {
   u32_t a = s[0];
@@ -90,6 +220,7 @@ static int read_pk0304_header(const gar_gfile_t *gf, pk0304_header_t *hdr,
   if (n < sizeof(s) || memcmp(s, "PK\3\4", 4)) {
     return 0; // there is no more PK0304 chunk.
   }
+  GAR_STAT_ADD(headers, 1);
 
   // Decode the header values.
   decode_u32_le(&s[0], &hdr->sig);
@@ -108,25 +239,508 @@ static int read_pk0304_header(const gar_gfile_t *gf, pk0304_header_t *hdr,
 }
 
 
-/// Full status of a zipped file.
-typedef struct gar_zstat {
-  gar_fstat_t fstat;
-  u16_t comp_method;
-  gar_off_t data_off;
-  gar_off_t data_len;
-} gar_zstat_t;
+/// Decode a PK0102 chunk header (central directory file header).
+/// @retval 1  if the header is successfully decoded.
+/// @retval 0  if the given bytes are not a PK0102 chunk header.
+static int decode_pk0102_header(const byte_t s[46], pk0102_header_t *hdr) {
+  if (memcmp(s, "PK\1\2", 4)) {
+    return 0; // not a PK0102 chunk.
+  }
 
+  // Decode the header values.
+  decode_u32_le(&s[0], &hdr->sig);
+  decode_u16_le(&s[4], &hdr->made_ver);
+  decode_u16_le(&s[6], &hdr->need_ver);
+  decode_u16_le(&s[8], &hdr->flags);
+  decode_u16_le(&s[10], &hdr->comp_method);
+  decode_u16_le(&s[12], &hdr->last_mod_time);
+  decode_u16_le(&s[14], &hdr->last_mod_date);
+  decode_u32_le(&s[16], &hdr->crc32);
+  decode_u32_le(&s[20], &hdr->comp_size);
+  decode_u32_le(&s[24], &hdr->uncomp_size);
+  decode_u16_le(&s[28], &hdr->fname_len);
+  decode_u16_le(&s[30], &hdr->extra_len);
+  decode_u16_le(&s[32], &hdr->comment_len);
+  decode_u16_le(&s[34], &hdr->disk_start);
+  decode_u16_le(&s[36], &hdr->int_attr);
+  decode_u32_le(&s[38], &hdr->ext_attr);
+  decode_u32_le(&s[42], &hdr->hdr_off);
 
-/// Enumerate all the zipped files.
-int gar_enum(gar_t *G, gar_enum_t fn, void *ud, jmp_buf _env) {
+  return 1;
+}
+
+
+/// Decode a PK0506 chunk header (end of central directory record).
+/// @retval 1  if the header is successfully decoded.
+/// @retval 0  if the given bytes are not a PK0506 chunk header.
+static int decode_pk0506_header(const byte_t s[22], pk0506_header_t *hdr) {
+  if (memcmp(s, "PK\5\6", 4)) {
+    return 0; // not a PK0506 chunk.
+  }
+
+  // Decode the header values.
+  decode_u32_le(&s[0], &hdr->sig);
+  decode_u16_le(&s[4], &hdr->disk);
+  decode_u16_le(&s[6], &hdr->cd_disk);
+  decode_u16_le(&s[8], &hdr->disk_entries);
+  decode_u16_le(&s[10], &hdr->total_entries);
+  decode_u32_le(&s[12], &hdr->cd_size);
+  decode_u32_le(&s[16], &hdr->cd_off);
+  decode_u16_le(&s[20], &hdr->comment_len);
+
+  return 1;
+}
+
+
+/// Decode a PK0606 chunk header (ZIP64 end of central directory record).
+/// @retval 1  if the header is successfully decoded.
+/// @retval 0  if the given bytes are not a PK0606 chunk header.
+static int decode_pk0606_header(const byte_t s[56], pk0606_header_t *hdr) {
+  if (memcmp(s, "PK\6\6", 4)) {
+    return 0; // not a PK0606 chunk.
+  }
+
+  // Decode the header values.
+  decode_u32_le(&s[0], &hdr->sig);
+  decode_u64_le(&s[4], &hdr->rec_size);
+  decode_u16_le(&s[12], &hdr->made_ver);
+  decode_u16_le(&s[14], &hdr->need_ver);
+  decode_u32_le(&s[16], &hdr->disk);
+  decode_u32_le(&s[20], &hdr->cd_disk);
+  decode_u64_le(&s[24], &hdr->disk_entries);
+  decode_u64_le(&s[32], &hdr->total_entries);
+  decode_u64_le(&s[40], &hdr->cd_size);
+  decode_u64_le(&s[48], &hdr->cd_off);
+
+  return 1;
+}
+
+
+/// Decode a PK0607 chunk header (ZIP64 end of central directory locator).
+/// @retval 1  if the header is successfully decoded.
+/// @retval 0  if the given bytes are not a PK0607 chunk header.
+static int decode_pk0607_header(const byte_t s[20], pk0607_header_t *hdr) {
+  if (memcmp(s, "PK\6\7", 4)) {
+    return 0; // not a PK0607 chunk.
+  }
+
+  // Decode the header values.
+  decode_u32_le(&s[0], &hdr->sig);
+  decode_u32_le(&s[4], &hdr->eocd_disk);
+  decode_u64_le(&s[8], &hdr->eocd_off);
+  decode_u32_le(&s[16], &hdr->total_disks);
+
+  return 1;
+}
+
+
+/**
+ * @brief Decode the ZIP64 extended information extra field (tag 0x0001).
+ *
+ * The field in the extra field @a s of @a n bytes has the 64-bit values of
+ * the uncompressed size, the compressed size and the header offset in this
+ * order, only for the ones saturated (0xffffffff) in the header; they replace
+ * @a *uncomp_size, @a *comp_size and @a *hdr_off, each of which can be NULL
+ * if the header does not have it.
+ * @retval 1  if the field is found.
+ * @retval 0  if there is no such field.
+ */
+int _gar_zip64_extra(const byte_t *s, size_t n, gar_off_t *uncomp_size,
+                     gar_off_t *comp_size, gar_off_t *hdr_off) {
+  gar_off_t *vals[3];
+  size_t off;
+  size_t len;
+  u16_t tag;
+  u16_t m;
+  int i;
+
+  vals[0] = uncomp_size;
+  vals[1] = comp_size;
+  vals[2] = hdr_off;
+
+  for (off = 0; n - off >= 4; off += 4 + m) {
+    decode_u16_le(&s[off], &tag);
+    decode_u16_le(&s[off + 2], &m);
+    if (n - off - 4 < m) {
+      break; // damaged extra field.
+    }
+    if (tag == 0x0001) {
+      // Take the values of the field as far as it has.
+      for (len = 0, i = 0; i < 3; i++) {
+        if (vals[i] != NULL && *vals[i] == 0xffffffffUL && m - len >= 8) {
+          decode_u64_le(&s[off + 4 + len], vals[i]);
+          len += 8;
+        }
+      }
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+
+//-----------------------------------------------------------------------------
+// Index
+
+/// Calculate the hash value of a file name (FNV-1a).
+static size_t hash_fname(const char *fname, size_t len) {
+  size_t h = 2166136261U;
+  size_t i;
+  for (i = 0; i < len; i++) {
+    h = (h ^ (byte_t)fname[i]) * 16777619U;
+  }
+  return h;
+}
+
+
+/// Get the file name of an index entry.
+static const char *entry_fname(const gar_t *G, const gar_entry_t *e) {
+  return &G->names[e->fname_off];
+}
+
+
+/// Append a zipped file's status to the index.
+/// The file name and the hash value of @a e are set by this function; the
+/// name is no longer than 65535 bytes, as the headers give it.
+static void add_entry(gar_t *G, gar_entry_t *e, const char *fname,
+                      size_t fname_len, jmp_buf env) {
+  // Extend the entry array if it is full.
+  if (G->num_entries == G->entries_cap) {
+    size_t cap = (G->entries_cap > 0) ? G->entries_cap * 2 : 64;
+    G->entries = _gar_realloc(G->entries, sizeof(gar_entry_t) * cap, env);
+    G->entries_cap = cap;
+  }
+
+  // Extend the file name pool if it is too short.
+  if (G->names_cap - G->names_len < fname_len + 1) {
+    size_t cap = (G->names_cap > 0) ? G->names_cap * 2 : 1024;
+    while (cap - G->names_len < fname_len + 1) cap *= 2;
+    G->names = _gar_realloc(G->names, cap, env);
+    G->names_cap = cap;
+  }
+
+  // Store the file name.
+  memcpy(&G->names[G->names_len], fname, fname_len);
+  G->names[G->names_len + fname_len] = 0;
+  e->fname_off = G->names_len;
+  e->fname_len = (u16_t)fname_len;
+  e->hash = hash_fname(fname, fname_len);
+  G->names_len += fname_len + 1;
+
+  G->entries[G->num_entries++] = *e;
+}
+
+
+/// Discard all the indexed entries.
+static void clear_entries(gar_t *G) {
+  G->num_entries = 0;
+  G->names_len = 0;
+}
+
+
+/// Build the hash table over the indexed entries.
+static void build_hash(gar_t *G, jmp_buf env) {
+  size_t i;
+  size_t cap = 16;
+
+  // Keep the load factor of the table no more than 1/2.
+  while (cap < G->num_entries * 2) cap *= 2;
+  G->hash = _gar_malloc(sizeof(size_t) * cap, env);
+  G->hash_mask = cap - 1;
+  memset(G->hash, 0, sizeof(size_t) * cap);
+
+  // Insert the entries in the directory order so that the first one of the
+  // same-named entries is found first.
+  for (i = 0; i < G->num_entries; i++) {
+    size_t j = G->entries[i].hash & G->hash_mask;
+    while (G->hash[j] != 0) j = (j + 1) & G->hash_mask;
+    G->hash[j] = i + 1;
+  }
+}
+
+
+/// Sort the entries by the file name in bytes; the same-named entries are kept
+/// in the directory order (bottom-up merge sort).
+static void build_sorted(gar_t *G, jmp_buf _env) {
+  jmp_buf env;
+  size_t *volatile tmp = NULL;
+  size_t *a, *b, *t;
+  size_t n = G->num_entries;
+  size_t w, lo, i, j, k, mid, hi;
+
+  if (setjmp(env)) {
+    _gar_free(tmp);
+    longjmp(_env, 1);
+  }
+
+  G->sorted = _gar_malloc(sizeof(size_t) * (n + 1), env);
+  tmp = _gar_malloc(sizeof(size_t) * (n + 1), env);
+  for (i = 0; i < n; i++) G->sorted[i] = i;
+
+  a = G->sorted;
+  b = tmp;
+  for (w = 1; w < n; w *= 2) {
+    for (lo = 0; lo < n; lo += 2 * w) {
+      mid = (n - lo > w) ? lo + w : n;
+      hi = (n - mid > w) ? mid + w : n;
+      for (i = lo, j = mid, k = lo; k < hi; k++) {
+        if (j == hi || (i < mid &&
+                        strcmp(entry_fname(G, &G->entries[a[i]]),
+                               entry_fname(G, &G->entries[a[j]])) <= 0)) {
+          b[k] = a[i++];
+        } else {
+          b[k] = a[j++];
+        }
+      }
+    }
+    t = a;
+    a = b;
+    b = t;
+  }
+  if (a != G->sorted) memcpy(G->sorted, a, sizeof(size_t) * n);
+
+  _gar_free(tmp);
+}
+
+
+/// Compare the beginning of a file name with @a p of @a len bytes, followed
+/// by '/' if @a slash is nonzero.
+/// @return negative, zero or positive if the name is before, begins with, or
+///         is after it.
+static int compare_head(const char *fname, const char *p, size_t len,
+                        int slash) {
+  size_t i;
+  for (i = 0; i < len; i++) {
+    if (fname[i] != p[i]) return (int)(byte_t)fname[i] - (byte_t)p[i];
+  }
+  return (slash && fname[i] != '/') ? (int)(byte_t)fname[i] - '/' : 0;
+}
+
+
+/// Find the first of the sorted entries from @a lo whose name is after @a p
+/// if @a past is nonzero, or not before it otherwise (see compare_head()).
+static size_t find_bound(const gar_t *G, size_t lo, const char *p, size_t len,
+                         int slash, int past) {
+  size_t hi = G->num_entries;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    const gar_entry_t *e = &G->entries[G->sorted[mid]];
+    if (compare_head(entry_fname(G, e), p, len, slash) < past) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+
+/// Find out the index entry of the specified zipped file.
+/// @return the found entry, or NULL if the file is not found.
+static const gar_entry_t *find_entry(const gar_t *G, const char *fname) {
+  unsigned long long t = GAR_STAT_START();
+  size_t h = hash_fname(fname, strlen(fname));
+  size_t j;
+  const gar_entry_t *found = NULL;
+
+  for (j = h & G->hash_mask; G->hash[j] != 0; j = (j + 1) & G->hash_mask) {
+    const gar_entry_t *e = &G->entries[G->hash[j] - 1];
+    if (e->hash == h && strcmp(entry_fname(G, e), fname) == 0) {
+      found = e;
+      break;
+    }
+  }
+
+  GAR_STAT_STOP(GAR_STAGE_LOOKUP, t);
+  return found; // NULL if the file is not found.
+}
+
+
+/// Find out the PK0506 chunk (end of central directory record).
+/// @retval 1  if the chunk is found.
+/// @retval 0  if there is no valid PK0506 chunk.
+static int find_pk0506(gar_t *G, pk0506_header_t *hdr, gar_off_t *hdr_off,
+                       jmp_buf _env) {
+  jmp_buf env;
+  byte_t *volatile s = NULL;
+  const size_t max_tail = 22 + 65535; // the header and the longest comment.
+  gar_off_t fsize;
+  size_t n;
+  size_t i;
+  int found = 0;
+
+  if (setjmp(env)) {
+    _gar_free(s);
+    longjmp(_env, 1);
+  }
+
+  // Read the tail of the file which may contain the PK0506 chunk.
+  fsize = gar_gfile_size(&G->gf, env);
+  n = (fsize < max_tail) ? (size_t)fsize : max_tail;
+  if (n < 22) {
+    return 0; // too short to be a zip archive.
+  }
+  s = _gar_malloc(n, env);
+  gar_gfile_seek(&G->gf, fsize - n, env);
+  if (gar_gfile_read(&G->gf, s, n, env) < n) {
+    _gar_free(s);
+    return 0; // insufficient input data.
+  }
+
+  // Search for the signature backward, since the archive comment may contain
+  // the signature-like bytes.
+  for (i = n - 22 + 1; i-- > 0; ) {
+    if (decode_pk0506_header(&s[i], hdr) && i + 22 + hdr->comment_len <= n) {
+      *hdr_off = fsize - n + i;
+      found = 1;
+      break;
+    }
+  }
+
+  _gar_free(s);
+
+  return found;
+}
+
+
+/// Find out the PK0606 chunk (ZIP64 end of central directory record) by the
+/// PK0607 chunk (locator) just before the PK0506 chunk at @a eocd_off.
+/// @retval 1  if the chunk is found.
+/// @retval 0  if there is no valid PK0606 chunk.
+static int find_pk0606(gar_t *G, gar_off_t eocd_off, pk0606_header_t *hdr,
+                       gar_off_t *hdr_off, jmp_buf env) {
+  byte_t s[56];
+  pk0607_header_t loc;
+
+  // Read the locator.
+  if (eocd_off < 20) {
+    return 0; // no room for the locator.
+  }
+  gar_gfile_seek(&G->gf, eocd_off - 20, env);
+  if (gar_gfile_read(&G->gf, s, 20, env) < 20 ||
+      !decode_pk0607_header(s, &loc) || loc.eocd_off > eocd_off - 20 ||
+      eocd_off - 20 - loc.eocd_off < 56) {
+    return 0; // missing or damaged locator.
+  }
+
+  // Read the record at the offset given by the locator.
+  gar_gfile_seek(&G->gf, loc.eocd_off, env);
+  if (gar_gfile_read(&G->gf, s, 56, env) < 56 ||
+      !decode_pk0606_header(s, hdr)) {
+    return 0; // damaged record.
+  }
+  *hdr_off = loc.eocd_off;
+
+  return 1;
+}
+
+
+/// Index the zipped files from the central directory.
+/// @retval 1  if the central directory is successfully read.
+/// @retval 0  if the central directory is missing or damaged.
+static int read_central_directory(gar_t *G, jmp_buf _env) {
+  jmp_buf env;
+  byte_t *volatile s = NULL;
+  pk0506_header_t eocd;
+  pk0606_header_t eocd64;
+  gar_off_t eocd_off;
+  gar_off_t cd_off;
+  gar_off_t cd_size;
+  gar_off_t num_entries;
+  gar_off_t entries_mask = 0xffffU;
+  size_t off;
+  size_t n;
+
+  if (setjmp(env)) {
+    _gar_free(s);
+    longjmp(_env, 1);
+  }
+
+  // Locate the central directory.
+  if (!find_pk0506(G, &eocd, &eocd_off, env) ||
+      eocd.disk != 0 || eocd.cd_disk != 0) {
+    return 0; // missing or spanned central directory.
+  }
+  cd_off = eocd.cd_off;
+  cd_size = eocd.cd_size;
+  num_entries = eocd.total_entries;
+
+  // Take the 64-bit values of the ZIP64 record if any, which precedes the
+  // PK0506 chunk whose values can be saturated.
+  if (find_pk0606(G, eocd_off, &eocd64, &eocd_off, env)) {
+    if (eocd64.disk != 0 || eocd64.cd_disk != 0) {
+      return 0; // spanned central directory.
+    }
+    cd_off = eocd64.cd_off;
+    cd_size = eocd64.cd_size;
+    num_entries = eocd64.total_entries;
+    entries_mask = ~(gar_off_t)0;
+  }
+  if (cd_off > eocd_off || cd_size > eocd_off - cd_off) {
+    return 0; // damaged central directory.
+  }
+
+  // Read the whole central directory at once.
+  n = (size_t)cd_size;
+  if ((gar_off_t)n != cd_size || n + 1 == 0) {
+    _gar_error(env, NULL, "too large central directory");
+  }
+  s = _gar_malloc(n + 1, env); // +1 not to allocate zero bytes.
+  gar_gfile_seek(&G->gf, cd_off, env);
+  if (gar_gfile_read(&G->gf, s, n, env) < n) {
+    _gar_free(s);
+    return 0; // insufficient input data.
+  }
+
+  // Index all the PK0102 chunks (central directory file headers).
+  for (off = 0; off < n; ) {
+    pk0102_header_t hdr;
+    gar_entry_t e;
+
+    if (n - off < 46 || !decode_pk0102_header(&s[off], &hdr) ||
+        n - off - 46 < (size_t)hdr.fname_len + hdr.extra_len +
+                       hdr.comment_len) {
+      break; // damaged central directory.
+    }
+
+    e.comp_method = hdr.comp_method;
+    e.crc32 = hdr.crc32;
+    e.mtime = ((u32_t)hdr.last_mod_date << 16) | hdr.last_mod_time;
+    e.comp_size = hdr.comp_size;
+    e.uncomp_size = hdr.uncomp_size;
+    e.hdr_off = hdr.hdr_off;
+    _gar_zip64_extra(&s[off + 46 + hdr.fname_len], hdr.extra_len,
+                     &e.uncomp_size, &e.comp_size, &e.hdr_off);
+    add_entry(G, &e, (const char *)&s[off + 46], hdr.fname_len, env);
+
+    off += 46 + hdr.fname_len + hdr.extra_len + hdr.comment_len;
+  }
+
+  _gar_free(s);
+
+  // Make sure that all the PK0102 chunks are read; the 16-bit number of them
+  // wraps around without the ZIP64 record.
+  if (off != n || ((gar_off_t)G->num_entries & entries_mask) != num_entries) {
+    clear_entries(G);
+    return 0; // damaged central directory.
+  }
+
+  return 1;
+}
+
+
+/// Index the zipped files by walking through the PK0304 chunks (local file
+/// headers) from the beginning of the file.
+static void scan_local_headers(gar_t *G, jmp_buf _env) {
   jmp_buf env;
   char *volatile fname = NULL;
   size_t fname_cap;
   const size_t initial_fname_cap = 128;
   pk0304_header_t hdr;
-  gar_zstat_t zstat;
+  gar_entry_t e;
   gar_off_t off;
-  int result;
+  size_t n;
 
   if (setjmp(env)) {
     _gar_free(fname);
@@ -137,79 +751,267 @@ int gar_enum(gar_t *G, gar_enum_t fn, void *ud, jmp_buf _env) {
   fname = _gar_malloc(initial_fname_cap, env);
   fname_cap = initial_fname_cap;
 
-  // Initialize the variables.
   off = 0;
-  result = 0;
 
   for (;;) {
     // Read the next pk0304 chunk header.
     gar_gfile_seek(&G->gf, off, env);
     if (!read_pk0304_header(&G->gf, &hdr, env)) break;
 
-    // Extend the file name buffer if it is too short.
-    if (fname_cap < hdr.fname_len+1U) {
-      fname = _gar_realloc(fname, hdr.fname_len+1U, env);
-      fname_cap = hdr.fname_len+1U;
+    // Extend the file name buffer if it is too short for the file name and
+    // the extra field.
+    n = (size_t)hdr.fname_len + hdr.extra_len;
+    if (fname_cap < n) {
+      fname = _gar_realloc(fname, n, env);
+      fname_cap = n;
     }
 
-    // Read the file name.
-    if (gar_gfile_read(&G->gf, fname, hdr.fname_len, env) < hdr.fname_len) {
+    // Read the file name and the extra field.
+    if (gar_gfile_read(&G->gf, fname, n, env) < n) {
       break; // insufficient input data.
     }
-    fname[hdr.fname_len] = 0;
-
-    // Invoke the callback function.
-    zstat.fstat.fname = fname;
-    zstat.fstat.fsize = hdr.uncomp_size;
-    zstat.comp_method = hdr.comp_method;
-    zstat.data_off = off + 30 + hdr.fname_len + hdr.extra_len;
-    zstat.data_len = hdr.comp_size;
-    result = (*fn)(&zstat.fstat, ud, env);
-    if (result != 0) break;
+
+    // Index the file.
+    e.comp_method = hdr.comp_method;
+    e.crc32 = hdr.crc32;
+    e.mtime = ((u32_t)hdr.last_mod_date << 16) | hdr.last_mod_time;
+    e.comp_size = hdr.comp_size;
+    e.uncomp_size = hdr.uncomp_size;
+    e.hdr_off = off;
+    _gar_zip64_extra((const byte_t *)&fname[hdr.fname_len], hdr.extra_len,
+                     &e.uncomp_size, &e.comp_size, NULL);
+    add_entry(G, &e, fname, hdr.fname_len, env);
 
     // Get the offset of the next chunk.
-    off += 30 + hdr.fname_len + hdr.extra_len + hdr.comp_size;
+    off += 30 + n + e.comp_size;
   }
 
   // Cleanup.
   _gar_free(fname);
+}
+
+
+/// Index all the zipped files by the hash table and in the name order.
+/// The local file headers are scanned only if the central directory is
+/// missing or damaged.
+static void build_index(gar_t *G, jmp_buf _env) {
+  jmp_buf env;
+  gar_stats_scope_t scope;
+
+  _gar_stats_begin(&scope, G->counters);
+  if (setjmp(env)) {
+    _gar_stats_end(&scope, G->counters);
+    longjmp(_env, 1);
+  }
+
+  if (!read_central_directory(G, env)) {
+    scan_local_headers(G, env);
+  }
+  build_hash(G, env);
+  build_sorted(G, env);
+  _gar_stats_end(&scope, G->counters);
+}
+
+
+//-----------------------------------------------------------------------------
+// Zipped Files
+
+/// Enumerate all the zipped files.
+int gar_enum(gar_t *G, gar_enum_t fn, void *ud, jmp_buf _env) {
+  jmp_buf env;
+  gar_stats_scope_t scope;
+  gar_fstat_t fstat;
+  size_t i;
+  int result = 0;
+
+  // End the measured call also at an error raised by the callback.
+  _gar_stats_begin(&scope, G->counters);
+  if (setjmp(env)) {
+    _gar_stats_end(&scope, G->counters);
+    longjmp(_env, 1);
+  }
+
+  for (i = 0; i < G->num_entries; i++) {
+    unsigned long long t = GAR_STAT_START();
+    const gar_entry_t *e = &G->entries[i];
+
+    // Invoke the callback function, whose time is not counted.
+    fstat.fname = entry_fname(G, e);
+    fstat.fsize = e->uncomp_size;
+    GAR_STAT_STOP(GAR_STAGE_LOOKUP, t);
+    result = (*fn)(&fstat, ud, env);
+    if (result != 0) break;
+  }
 
+  _gar_stats_end(&scope, G->counters);
   return result;
 }
 
 
-/// User-defined argument for the on_find() callback function.
-typedef struct find_ud {
-  const char *fname; ///< Name of the zipped file to find out.
-  gar_zstat_t *zstat; ///< Location to which to store the found file's status.
-} find_ud_t;
+/// Get the metadata of an index entry.
+static void entry_stat(const gar_t *G, const gar_entry_t *e,
+                       gar_entry_stat_t *st) {
+  st->version = GAR_ENTRY_STAT_VERSION;
+  st->name = entry_fname(G, e);
+  st->name_len = e->fname_len;
+  st->method = e->comp_method;
+  st->comp_size = e->comp_size;
+  st->fsize = e->uncomp_size;
+  st->crc32 = e->crc32;
+  st->hdr_off = e->hdr_off;
+  st->mtime = e->mtime;
+}
 
 
-/// Callback function to find out a zipped file.
-static int on_find(const gar_fstat_t *fstat, void *ud, jmp_buf env) {
-  const gar_zstat_t *zstat = (const gar_zstat_t *)fstat;
-  find_ud_t *fud = (find_ud_t *)ud;
-  ((void)env);
+/**
+ * @brief Enumerate all the zipped files with their metadata.
+ *
+ * The names are not copied: gar_entry_stat_t::name points into the index of
+ * the archive, which is valid until the archive is closed. The names given
+ * here are also NUL-terminated, but the callbacks shared with
+ * gar_list_dir() should use gar_entry_stat_t::name_len. The enumeration
+ * stops when @a fn returns nonzero, and the value is returned.
+ */
+int gar_enum_ex(gar_t *G, gar_enum_ex_t fn, void *ud, jmp_buf _env) {
+  jmp_buf env;
+  gar_stats_scope_t scope;
+  gar_entry_stat_t st;
+  size_t i;
+  int result = 0;
 
-  if (strcmp(fud->fname, zstat->fstat.fname) == 0) {
-    *(fud->zstat) = *zstat; // store the found file's status.
-    fud->zstat->fstat.fname = NULL; // fname is valid only in this call.
-    return 1; // stop enumeration.
-  } else {
-    return 0; // look for the next zipped file.
+  // End the measured call also at an error raised by the callback.
+  _gar_stats_begin(&scope, G->counters);
+  if (setjmp(env)) {
+    _gar_stats_end(&scope, G->counters);
+    longjmp(_env, 1);
   }
+
+  for (i = 0; i < G->num_entries; i++) {
+    unsigned long long t = GAR_STAT_START();
+
+    // Invoke the callback function, whose time is not counted.
+    entry_stat(G, &G->entries[i], &st);
+    GAR_STAT_STOP(GAR_STAGE_LOOKUP, t);
+    result = (*fn)(&st, ud, env);
+    if (result != 0) break;
+  }
+
+  _gar_stats_end(&scope, G->counters);
+  return result;
 }
 
 
-/// Get the full status of the specified zipped file.
-/// @retval 1  if the specified zipped file is found.
-/// @retval 0  if the specified zipped file is not found.
-static int gar_zstat(gar_t *G, const char *fname, gar_zstat_t *zstat,
-                     jmp_buf env) {
-  find_ud_t fud;
-  fud.fname = fname;
-  fud.zstat = zstat;
-  return gar_enum(G, &on_find, &fud, env); // return 1 if the file is found.
+/**
+ * @brief Enumerate the zipped files whose names begin with @a prefix, in the
+ * order of the names in bytes.
+ *
+ * The files are found by a binary search over the names sorted on opening
+ * the archive, in O(log N + k) for the k files found of N. The metadata is
+ * given as gar_enum_ex() gives, and the enumeration stops when @a fn returns
+ * nonzero, and the value is returned.
+ */
+int gar_enum_prefix(gar_t *G, const char *prefix, gar_enum_ex_t fn, void *ud,
+                    jmp_buf _env) {
+  jmp_buf env;
+  gar_stats_scope_t scope;
+  gar_entry_stat_t st;
+  size_t len = strlen(prefix);
+  size_t i;
+  int result = 0;
+  unsigned long long t;
+
+  // End the measured call also at an error raised by the callback.
+  _gar_stats_begin(&scope, G->counters);
+  if (setjmp(env)) {
+    _gar_stats_end(&scope, G->counters);
+    longjmp(_env, 1);
+  }
+
+  t = GAR_STAT_START();
+  for (i = find_bound(G, 0, prefix, len, 0, 0); i < G->num_entries; i++) {
+    const gar_entry_t *e = &G->entries[G->sorted[i]];
+    if (compare_head(entry_fname(G, e), prefix, len, 0) != 0) break;
+
+    // Invoke the callback function, whose time is not counted.
+    entry_stat(G, e, &st);
+    GAR_STAT_STOP(GAR_STAGE_LOOKUP, t);
+    result = (*fn)(&st, ud, env);
+    if (result != 0) break;
+    t = GAR_STAT_START();
+  }
+  if (result == 0) GAR_STAT_STOP(GAR_STAGE_LOOKUP, t);
+
+  _gar_stats_end(&scope, G->counters);
+  return result;
+}
+
+
+/**
+ * @brief Enumerate the files and the subdirectories just in the directory
+ * @a dir ("" for the top), in the order of the names in bytes.
+ *
+ * A subdirectory is given once, by its own entry if the archive has it, or
+ * by gar_entry_stat_t of zeros and the name, which ends with '/' and is not
+ * NUL-terminated; the files in it are skipped by a binary search, so it
+ * takes O((k + 1) log N) for the k files and subdirectories found of N. The
+ * entry of @a dir itself is not given. The enumeration stops when @a fn
+ * returns nonzero, and the value is returned.
+ */
+int gar_list_dir(gar_t *G, const char *dir, gar_enum_ex_t fn, void *ud,
+                 jmp_buf _env) {
+  jmp_buf env;
+  gar_stats_scope_t scope;
+  gar_entry_stat_t st;
+  size_t len = strlen(dir);
+  int slash = len > 0 && dir[len - 1] != '/'; // "a/b" is "a/b/".
+  size_t head = len + slash; // length of the directory name with '/'.
+  size_t i;
+  int result = 0;
+  unsigned long long t;
+
+  // End the measured call also at an error raised by the callback.
+  _gar_stats_begin(&scope, G->counters);
+  if (setjmp(env)) {
+    _gar_stats_end(&scope, G->counters);
+    longjmp(_env, 1);
+  }
+
+  t = GAR_STAT_START();
+  i = find_bound(G, 0, dir, len, slash, 0);
+  while (i < G->num_entries) {
+    const gar_entry_t *e = &G->entries[G->sorted[i]];
+    const char *fname = entry_fname(G, e);
+    const char *sep;
+
+    if (compare_head(fname, dir, len, slash) != 0) break;
+    if (fname[head] == 0) { // the directory itself.
+      i++;
+      continue;
+    }
+
+    sep = strchr(&fname[head], '/');
+    if (sep == NULL || sep[1] == 0) {
+      entry_stat(G, e, &st); // a file, or the entry of a subdirectory.
+    } else {
+      memset(&st, 0, sizeof(st));
+      st.version = GAR_ENTRY_STAT_VERSION;
+      st.name = fname;
+      st.name_len = sep + 1 - fname;
+    }
+    // Skip the files in the subdirectory.
+    i = (sep != NULL) ? find_bound(G, i + 1, fname, sep + 1 - fname, 0, 1) :
+                        i + 1;
+
+    // Invoke the callback function, whose time is not counted.
+    GAR_STAT_STOP(GAR_STAGE_LOOKUP, t);
+    result = (*fn)(&st, ud, env);
+    if (result != 0) break;
+    t = GAR_STAT_START();
+  }
+  if (result == 0) GAR_STAT_STOP(GAR_STAGE_LOOKUP, t);
+
+  _gar_stats_end(&scope, G->counters);
+  return result;
 }
 
 
@@ -217,10 +1019,17 @@ static int gar_zstat(gar_t *G, const char *fname, gar_zstat_t *zstat,
 /// @retval 1  if the specified zipped file is found.
 /// @retval 0  if the specified zipped file is not found.
 int gar_stat(gar_t *G, const char *fname, gar_fstat_t *fstat, jmp_buf env) {
-  gar_zstat_t zstat;
-  if (gar_zstat(G, fname, &zstat, env)) {
-    *fstat = zstat.fstat;
+  gar_stats_scope_t scope;
+  const gar_entry_t *e;
+  ((void)env);
+
+  _gar_stats_begin(&scope, G->counters);
+  e = find_entry(G, fname);
+  _gar_stats_end(&scope, G->counters);
+
+  if (e != NULL) {
     fstat->fname = fname;
+    fstat->fsize = e->uncomp_size;
     return 1; // the file is found.
   } else {
     fstat->fname = NULL;
@@ -230,34 +1039,178 @@ int gar_stat(gar_t *G, const char *fname, gar_fstat_t *fstat, jmp_buf env) {
 }
 
 
+/**
+ * @brief Set the allocator of the zipped files opened afterward.
+ *
+ * The data streams, the decompressed data of gar_read_all() and so on are
+ * allocated by @a A, which must be alive until they are freed. NULL restores
+ * the global allocator (see gar_set_allocator()). @a A is called from all the
+ * threads using the archive, including the workers of gar_extract_many(), so
+ * it must be thread-safe if the archive is shared; an arena is (see
+ * gar_arena_new()). It must not be called while the archive is used by other
+ * threads.
+ */
+void gar_archive_set_allocator(gar_t *G, const gar_allocator_t *A) {
+  G->alloc = A;
+}
+
+
+/// Get the allocator of the zipped files.
+static const gar_allocator_t *archive_allocator(const gar_t *G) {
+  return (G->alloc != NULL) ? G->alloc : _gar_global_allocator();
+}
+
+
+/// Get the number of the decompressors reused from the archive's pool (hits)
+/// and allocated newly (misses).
+void gar_get_pool_stats(gar_t *G, unsigned long *hits, unsigned long *misses) {
+  _gar_ipool_stats(G->pool, hits, misses);
+}
+
+
+/**
+ * @brief Turn on/off the statistics of an archive.
+ *
+ * The statistics are counted by the calling thread, and added to the
+ * archive's and the aggregate ones at the end of each call, so they cost a
+ * few atomic operations per call. The streams opened from the archive share
+ * its statistics. NULL @a G sets the default of the archives opened
+ * afterward, which is off. The library compiled with GAR_NO_STATS has no
+ * statistics.
+ */
+void gar_set_stats(gar_t *G, int on) {
+  _gar_counters_set((G != NULL) ? G->counters : _gar_counters_total(), on);
+}
+
+
+/// Get the statistics of an archive, or the aggregate of all the archives if
+/// @a G is NULL.
+void gar_get_stats(const gar_t *G, gar_stats_t *S) {
+  _gar_counters_get((G != NULL) ? G->counters : _gar_counters_total(), S);
+}
+
+
+/// Reset the statistics of an archive, or the aggregate if @a G is NULL.
+void gar_reset_stats(gar_t *G) {
+  _gar_counters_reset((G != NULL) ? G->counters : _gar_counters_total());
+}
+
+
+/// Turn on/off the CRC-32 verification of the zipped files opened afterward.
+/// The verification is turned on by default.
+void gar_set_verify(gar_t *G, int on) {
+  G->verify = on;
+}
+
+
+/**
+ * @brief Decompress each large zipped file by the threads in gar_read_all()
+ * and gar_read_into().
+ *
+ * A deflated file of two chunks of @a chunk bytes (4MB if 0) or more is split
+ * into so many chunks for @a nthreads threads (0 for all the online
+ * processors, or 1 not to split; 1 by default), which decompress them at the
+ * same time; the data and the errors are the same as the serial ones. The
+ * compressed data of an archive opened by gar_archive_open_file() (or from
+ * any stream which cannot be viewed) is read onto memory first, so it costs
+ * a memory block of the compressed size besides the buffer, allocated by the
+ * archive's allocator; the mapped or memory archives are decompressed in
+ * place. It must not be called while the archive is used by other threads.
+ */
+void gar_set_parallel(gar_t *G, int nthreads, gar_off_t chunk) {
+  G->nthreads = nthreads;
+  G->chunk = (chunk > 0) ? chunk : default_chunk;
+}
+
+
 struct gar_fdata {
   gar_gfile_t gf;
+  int verify; ///< Whether to verify the CRC-32 and the size at the EOF.
+  u32_t crc32; ///< Expected CRC-32 value.
+  u32_t crc; ///< CRC-32 value of the read bytes.
+  gar_off_t size; ///< Expected size.
+  gar_off_t pos; ///< Number of the read bytes.
+  gar_counters_t *counters; ///< Statistics shared with the archive.
+  char *fname; ///< Name of the zipped file, copied after the structure.
 };
 
 
+/// Open a zipped file's (compressed) data as a partial stream of the archive.
+static void open_entry_data(gar_t *G, const gar_entry_t *e, gar_gfile_v *gf,
+                            jmp_buf _env) {
+  jmp_buf env;
+  pk0304_header_t hdr;
+  gar_off_t data_off;
+  const gar_allocator_t *prev;
+  unsigned long long t = GAR_STAT_START();
+
+  // Allocate the streams by the archive's allocator.
+  prev = _gar_use_allocator(archive_allocator(G));
+  if (setjmp(env)) {
+    _gar_use_allocator(prev);
+    longjmp(_env, 1);
+  }
+
+  // Get the data offset from the PK0304 chunk header (local file header),
+  // whose extra field can differ from the central directory's one.
+  gar_gfile_dup(&G->gf, (gar_gfile_t *)gf, env);
+  gar_gfile_seek((gar_gfile_t *)gf, e->hdr_off, env);
+  if (!read_pk0304_header((gar_gfile_t *)gf, &hdr, env)) {
+    _gar_error(env, entry_fname(G, e), "broken local file header");
+  }
+  data_off = e->hdr_off + 30 + hdr.fname_len + hdr.extra_len;
+
+  gar_gfile_open_part(gf, data_off, e->comp_size, env);
+
+  _gar_use_allocator(prev);
+  GAR_STAT_STOP(GAR_STAGE_HEADER, t);
+}
+
+
 /// Open a zipped file's data stream.
-static gar_fdata_t *open_fdata(gar_t *G, const gar_zstat_t *zstat,
-                               jmp_buf _env) {
+static gar_fdata_t *open_fdata(gar_t *G, const gar_entry_t *e,
+                               const gar_open_opts_t *O, jmp_buf _env) {
   jmp_buf env;
   gar_fdata_t *volatile fd = NULL;
+  const gar_allocator_t *prev;
 
+  // Allocate the streams (and the chunks read ahead) by the archive's
+  // allocator.
+  prev = _gar_use_allocator(archive_allocator(G));
   if (setjmp(env)) {
+    _gar_use_allocator(prev);
     gar_close(fd);
     longjmp(_env, 1);
   }
 
-  // Allocate a new gar_fdata_t structure and initialize it.
-  fd = _gar_malloc(sizeof(gar_fdata_t), env);
+  // Allocate a new gar_fdata_t structure and initialize it; the name is kept
+  // for the errors, since the stream can outlive the archive.
+  fd = _gar_malloc_by(archive_allocator(G),
+                      sizeof(gar_fdata_t) + e->fname_len + 1, env);
+  fd->fname = (char *)(fd + 1);
+  memcpy(fd->fname, entry_fname(G, e), e->fname_len + 1);
   gar_gfile_null(&fd->gf);
+  fd->verify = G->verify;
+  fd->crc32 = e->crc32;
+  fd->crc = 0;
+  fd->size = e->uncomp_size;
+  fd->pos = 0;
+  fd->counters = _gar_counters_share(G->counters);
 
   // Open the zipped file's data stream.
-  gar_gfile_dup(&G->gf, &fd->gf, env);
-  gar_gfile_open_part(&fd->gf, zstat->data_off, zstat->data_len, env);
+  open_entry_data(G, e, &fd->gf, env);
+  if (O != NULL && O->readahead > 0) {
+    _gar_gfile_part_readahead(&fd->gf, O->readahead);
+  }
 
-  if (zstat->comp_method == 8) {
-    gar_inflate(&fd->gf, env);
+  if (e->comp_method == 8) {
+    _gar_inflate(&fd->gf, G->pool, O, env);
+  }
+  if (O != NULL && O->async > 0) {
+    _gar_gfile_async(&fd->gf, O->async, fd->counters, env);
   }
 
+  _gar_use_allocator(prev);
   return fd;
 }
 
@@ -265,21 +1218,161 @@ static gar_fdata_t *open_fdata(gar_t *G, const gar_zstat_t *zstat,
 /// Open a zipped file's data stream.
 /// @return a gar_fdata_t pointer, or NULL if the specified file is not found.
 gar_fdata_t *gar_open(gar_t *G, const char *fname, jmp_buf env) {
-  gar_zstat_t zstat;
-  if (gar_zstat(G, fname, &zstat, env)) {
-    return open_fdata(G, &zstat, env);
+  return gar_open_ex(G, fname, NULL, env);
+}
+
+
+/**
+ * @brief Open a zipped file's data stream with its access point index.
+ *
+ * gar_seek() on the stream resumes the decompression from the nearest access
+ * point of @a X, which has to be alive until the stream is closed.
+ * @return a gar_fdata_t pointer, or NULL if the specified file is not found.
+ */
+gar_fdata_t *gar_open_indexed(gar_t *G, const char *fname,
+                              const gar_zindex_t *X, jmp_buf env) {
+  gar_open_opts_t opts;
+  memset(&opts, 0, sizeof(opts));
+  opts.index = X;
+  return gar_open_ex(G, fname, &opts, env);
+}
+
+
+/**
+ * @brief Open a zipped file's data stream with the options.
+ *
+ * gar_open_opts_t::bufsize sets the bytes of the compressed data read from
+ * the archive at once (32KB by default); the larger, the fewer round trips
+ * on a network file system. Nonzero gar_open_opts_t::readahead lets the
+ * archive file read the compressed data so many bytes ahead of the reads in
+ * the background (posix_fadvise()), and gar_open_opts_t::index is the access
+ * point index of gar_open_indexed(). Nonzero gar_open_opts_t::async lets a
+ * helper thread decompress so many chunks of 64KB ahead of gar_read(), which
+ * then only copies the decompressed data; an error of the helper is raised by
+ * the next gar_read(). NULL @a opts is the defaults.
+ * @return a gar_fdata_t pointer, or NULL if the specified file is not found.
+ */
+gar_fdata_t *gar_open_ex(gar_t *G, const char *fname,
+                         const gar_open_opts_t *opts, jmp_buf _env) {
+  jmp_buf env;
+  gar_stats_scope_t scope;
+  const gar_entry_t *e;
+  gar_fdata_t *fd = NULL; // NULL if the file is not found.
+
+  _gar_stats_begin(&scope, G->counters);
+  if (setjmp(env)) {
+    _gar_stats_end(&scope, G->counters);
+    longjmp(_env, 1);
+  }
+
+  e = find_entry(G, fname);
+  if (e != NULL) {
+    fd = open_fdata(G, e, opts, env);
+  }
+  _gar_stats_end(&scope, G->counters);
+
+  return fd;
+}
+
+
+/**
+ * @brief Move to the specified offset of a zipped file's data stream.
+ *
+ * A compressed file is decompressed from the nearest access point before the
+ * offset if the stream is opened by gar_open_indexed(), or from the beginning
+ * otherwise. The CRC-32 is no longer verified after seeking.
+ */
+void gar_seek(gar_fdata_t *fd, gar_off_t off, jmp_buf _env) {
+  jmp_buf env;
+  gar_stats_scope_t scope;
+
+  if (fd != NULL) {
+    _gar_stats_begin(&scope, fd->counters);
+    if (setjmp(env)) {
+      _gar_stats_end(&scope, fd->counters);
+      longjmp(_env, 1);
+    }
+    gar_gfile_seek(&fd->gf, off, env);
+    fd->verify = 0; // the skipped bytes are not checked.
+    _gar_stats_end(&scope, fd->counters);
+  }
+}
+
+
+/**
+ * @brief Make the access point index of a zipped file.
+ *
+ * The file is decompressed once, and the access points are recorded every
+ * @a span bytes or more of the decompressed data; each point keeps 32KB of
+ * the history. A stored file has no access point, since it can be sought
+ * directly.
+ * @return a new index, or NULL if the specified file is not found.
+ */
+gar_zindex_t *gar_zindex_build(gar_t *G, const char *fname, gar_off_t span,
+                               jmp_buf _env) {
+  jmp_buf env;
+  gar_stats_scope_t scope;
+  const gar_entry_t *e;
+  gar_gfile_t gf;
+  gar_zindex_t *X = NULL; // NULL if the file is not found.
+  gar_gfile_null(&gf);
+
+  _gar_stats_begin(&scope, G->counters);
+
+  if (setjmp(env)) {
+    gar_gfile_close(&gf);
+    _gar_stats_end(&scope, G->counters);
+    longjmp(_env, 1);
+  }
+
+  e = find_entry(G, fname);
+  if (e == NULL) {
+    // the file is not found.
+  } else if (e->comp_method == 8) {
+    open_entry_data(G, e, &gf, env);
+    X = _gar_zindex_build(&gf, span, G->pool, env);
+    gar_gfile_close(&gf);
   } else {
-    return NULL; // the file is not found.
+    X = _gar_zindex_new(span, env);
   }
+
+  _gar_stats_end(&scope, G->counters);
+  return X;
 }
 
 
 /// Read bytes from a zipped file's data stream.
 /// @return number of the read bytes; this value can be less than the specified
 /// if and only if there is no more byte to read (reached the EOF).
-size_t gar_read(gar_fdata_t *fd, void *ptr, size_t n, jmp_buf env) {
+size_t gar_read(gar_fdata_t *fd, void *ptr, size_t n, jmp_buf _env) {
+  jmp_buf env;
+  gar_stats_scope_t scope;
+  size_t nread;
+
   if (fd != NULL) {
-    return gar_gfile_read(&fd->gf, ptr, n, env);
+    _gar_stats_begin(&scope, fd->counters);
+    if (setjmp(env)) {
+      _gar_stats_end(&scope, fd->counters);
+      longjmp(_env, 1);
+    }
+    nread = gar_gfile_read(&fd->gf, ptr, n, env);
+    if (fd->verify) {
+      unsigned long long t = GAR_STAT_START();
+      fd->crc = gar_crc32(fd->crc, ptr, nread);
+      GAR_STAT_STOP(GAR_STAGE_CRC, t);
+      fd->pos += nread;
+      // Check the zipped file on reaching the EOF or the expected size.
+      if (nread < n || fd->pos >= fd->size) {
+        if (fd->pos != fd->size) {
+          _gar_error(env, fd->fname, "size mismatch");
+        }
+        if (fd->crc != fd->crc32) {
+          _gar_error(env, fd->fname, "CRC-32 mismatch");
+        }
+      }
+    }
+    _gar_stats_end(&scope, fd->counters);
+    return nread;
   } else {
     return 0; // emulating empty file.
   }
@@ -290,6 +1383,341 @@ size_t gar_read(gar_fdata_t *fd, void *ptr, size_t n, jmp_buf env) {
 void gar_close(gar_fdata_t *fd) {
   if (fd != NULL) {
     gar_gfile_close(&fd->gf);
+    _gar_counters_release(fd->counters);
     _gar_free(fd);
   }
 }
+
+
+/**
+ * @brief Decompress the whole data of a zipped file into the buffer.
+ *
+ * The buffer must have the room for the uncompressed size of the file. The
+ * data is decompressed by a single call straight into the buffer, without the
+ * data stream of gar_open(); by the threads if @a parallel is nonzero and the
+ * file is large enough (see gar_set_parallel()).
+ */
+static void read_entry(gar_t *G, const gar_entry_t *e, void *ptr,
+                       int parallel, jmp_buf _env) {
+  jmp_buf env;
+  gar_gfile_t gf;
+  size_t size = (size_t)e->uncomp_size;
+  size_t n;
+  unsigned long long t;
+  const gar_allocator_t *prev;
+  gar_gfile_null(&gf);
+
+  // Allocate the stream and the memory of the threads by the archive's
+  // allocator.
+  prev = _gar_use_allocator(archive_allocator(G));
+  if (setjmp(env)) {
+    _gar_use_allocator(prev);
+    gar_gfile_close(&gf);
+    longjmp(_env, 1);
+  }
+
+  open_entry_data(G, e, &gf, env);
+
+  if (e->comp_method == 8 && parallel && G->nthreads != 1 &&
+      e->comp_size / 2 >= G->chunk) {
+    n = _gar_inflate_parallel(&gf, ptr, size, G->nthreads, G->chunk, G->pool,
+                              G->counters, env);
+  } else if (e->comp_method == 8) {
+    n = _gar_inflate_buffer(&gf, ptr, size, G->pool, env);
+  } else {
+    n = gar_gfile_read(&gf, ptr, size, env);
+    if (n == size && e->comp_size != e->uncomp_size) n++; // too long.
+  }
+  if (n != size) {
+    _gar_error(env, entry_fname(G, e), "size mismatch");
+  }
+  t = GAR_STAT_START();
+  if (G->verify && gar_crc32(0, ptr, size) != e->crc32) {
+    _gar_error(env, entry_fname(G, e), "CRC-32 mismatch");
+  }
+  GAR_STAT_STOP(GAR_STAGE_CRC, t);
+
+  gar_gfile_close(&gf);
+  _gar_use_allocator(prev);
+}
+
+
+/**
+ * @brief Read the whole data of a zipped file onto a new memory block.
+ *
+ * The memory block is allocated just once, in the uncompressed size of the
+ * file; it has to be freed by gar_free().
+ * @retval 1  if the specified zipped file is found.
+ * @retval 0  if the specified zipped file is not found.
+ */
+int gar_read_all(gar_t *G, const char *fname, void **ptr, size_t *len,
+                 jmp_buf _env) {
+  jmp_buf env;
+  gar_stats_scope_t scope;
+  const gar_entry_t *e;
+  void *volatile buf = NULL;
+  size_t size;
+
+  _gar_stats_begin(&scope, G->counters);
+  e = find_entry(G, fname);
+
+  *ptr = NULL;
+  *len = 0;
+  if (e == NULL) {
+    _gar_stats_end(&scope, G->counters);
+    return 0; // the file is not found.
+  }
+
+  if (setjmp(env)) {
+    _gar_stats_end(&scope, G->counters);
+    _gar_free(buf);
+    longjmp(_env, 1);
+  }
+
+  size = (size_t)e->uncomp_size;
+  if ((gar_off_t)size != e->uncomp_size) {
+    _gar_error(env, fname, "too large file");
+  }
+  buf = _gar_malloc_by(archive_allocator(G), size > 0 ? size : 1, env);
+  read_entry(G, e, buf, 1, env);
+  _gar_stats_end(&scope, G->counters);
+
+  *ptr = buf;
+  *len = size;
+  return 1; // the file is found.
+}
+
+
+/**
+ * @brief Read the whole data of a zipped file into the given buffer.
+ *
+ * Raises error if the buffer is smaller than the file.
+ * @retval 1  if the specified zipped file is found.
+ * @retval 0  if the specified zipped file is not found.
+ */
+int gar_read_into(gar_t *G, const char *fname, void *ptr, size_t n,
+                  size_t *len, jmp_buf _env) {
+  jmp_buf env;
+  gar_stats_scope_t scope;
+  const gar_entry_t *e;
+
+  _gar_stats_begin(&scope, G->counters);
+  e = find_entry(G, fname);
+
+  *len = 0;
+  if (e == NULL) {
+    _gar_stats_end(&scope, G->counters);
+    return 0; // the file is not found.
+  }
+
+  if (setjmp(env)) {
+    _gar_stats_end(&scope, G->counters);
+    longjmp(_env, 1);
+  }
+
+  if (e->uncomp_size > n) {
+    _gar_error(env, fname, "too small buffer");
+  }
+  read_entry(G, e, ptr, 1, env);
+  _gar_stats_end(&scope, G->counters);
+
+  *len = (size_t)e->uncomp_size;
+  return 1; // the file is found.
+}
+
+
+/// Free a memory block allocated by the library (e.g. gar_read_all()).
+void gar_free(void *ptr) {
+  _gar_free(ptr);
+}
+
+
+//-----------------------------------------------------------------------------
+// Parallel Extraction
+
+/// Zipped file to be extracted by gar_extract_many().
+typedef struct extract_item {
+  const gar_entry_t *e;
+  const char *fname; ///< The name given by the caller.
+} extract_item_t;
+
+
+/// Extraction shared by the worker threads.
+typedef struct extract_job {
+  gar_t *G;
+  extract_item_t *items; ///< Zipped files in the descending compressed size.
+  size_t num_items;
+  size_t next; ///< Index of the next item to be taken (atomic).
+  int stop; ///< Nonzero if the extraction is stopped (atomic).
+  int failed; ///< Nonzero if any error is raised (atomic).
+  int result; ///< Nonzero value returned by the callback function.
+  gar_sink_t fn;
+  void *ud;
+  pthread_mutex_t sink_lock; ///< Serializes the callback function calls.
+} extract_job_t;
+
+
+/// Compare the zipped files in the descending compressed size.
+static int compare_item(const void *a, const void *b) {
+  gar_off_t x = ((const extract_item_t *)a)->e->comp_size;
+  gar_off_t y = ((const extract_item_t *)b)->e->comp_size;
+  return (x < y) - (x > y);
+}
+
+
+/// Extract one zipped file and pass the data to the callback function.
+static void extract_item(extract_job_t *job, const extract_item_t *item,
+                         jmp_buf _env) {
+  jmp_buf env;
+  gar_stats_scope_t scope;
+  void *volatile buf = NULL;
+  gar_fstat_t fstat;
+  size_t size;
+  int result;
+
+  _gar_stats_begin(&scope, job->G->counters);
+  if (setjmp(env)) {
+    _gar_stats_end(&scope, job->G->counters);
+    _gar_free(buf);
+    longjmp(_env, 1);
+  }
+
+  fstat.fname = item->fname;
+  fstat.fsize = item->e->uncomp_size;
+  size = (size_t)fstat.fsize;
+  if ((gar_off_t)size != fstat.fsize) {
+    _gar_error(env, fstat.fname, "too large file");
+  }
+  buf = _gar_malloc_by(archive_allocator(job->G), size > 0 ? size : 1, env);
+  read_entry(job->G, item->e, buf, 0, env); // the files are in parallel.
+  _gar_stats_end(&scope, job->G->counters);
+
+  pthread_mutex_lock(&job->sink_lock);
+  if (!__atomic_load_n(&job->stop, __ATOMIC_RELAXED)) {
+    if (setjmp(env)) {
+      pthread_mutex_unlock(&job->sink_lock);
+      _gar_free(buf);
+      longjmp(_env, 1);
+    }
+    result = (*job->fn)(&fstat, buf, job->ud, env);
+    if (result != 0) {
+      job->result = result;
+      __atomic_store_n(&job->stop, 1, __ATOMIC_RELAXED);
+    }
+  }
+  pthread_mutex_unlock(&job->sink_lock);
+
+  _gar_free(buf);
+}
+
+
+/// Take the zipped files from the shared queue until it gets empty.
+static void *extract_worker(void *arg) {
+  extract_job_t *job = (extract_job_t *)arg;
+  jmp_buf env;
+  size_t i;
+
+  if (setjmp(env)) {
+    __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&job->stop, 1, __ATOMIC_RELAXED);
+    return NULL;
+  }
+
+  while (!__atomic_load_n(&job->stop, __ATOMIC_RELAXED)) {
+    i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+    if (i >= job->num_items) break;
+    extract_item(job, &job->items[i], env);
+  }
+
+  return NULL;
+}
+
+
+/**
+ * @brief Extract the specified zipped files by the worker threads.
+ *
+ * Each zipped file is decompressed by a worker thread with its own stream
+ * and decompressor, and passed to the callback function in the order of the
+ * completion; the callback function is never called concurrently, and the
+ * data is valid only during the call. gar_fstat_t::fname is the pointer
+ * given in @a fnames. The largest files are taken first so that the workers
+ * finish at nearly the same time.
+ *
+ * @param nthreads  number of the worker threads, or 0 to use all the online
+ * processors.
+ * @return 0 if all the files are extracted, or the nonzero value returned by
+ * the callback function to stop the extraction.
+ */
+int gar_extract_many(gar_t *G, const char *const fnames[], size_t n,
+                     gar_sink_t fn, void *ud, int nthreads, jmp_buf _env) {
+  jmp_buf env;
+  gar_stats_scope_t scope;
+  extract_job_t job;
+  extract_item_t *volatile items = NULL;
+  pthread_t *volatile threads = NULL;
+  volatile size_t num_threads = 0;
+  size_t i;
+
+  job.G = G;
+  job.items = NULL;
+  job.num_items = n;
+  job.next = 0;
+  job.stop = 0;
+  job.failed = 0;
+  job.result = 0;
+  job.fn = fn;
+  job.ud = ud;
+  pthread_mutex_init(&job.sink_lock, NULL);
+
+  if (setjmp(env)) {
+    _gar_free(items);
+    _gar_free(threads);
+    pthread_mutex_destroy(&job.sink_lock);
+    longjmp(_env, 1);
+  }
+
+  // Look up all the zipped files and sort them by the compressed size.
+  items = _gar_malloc(sizeof(extract_item_t) * (n > 0 ? n : 1), env);
+  _gar_stats_begin(&scope, G->counters);
+  for (i = 0; i < n; i++) {
+    items[i].e = find_entry(G, fnames[i]);
+    items[i].fname = fnames[i];
+    if (items[i].e == NULL) break;
+  }
+  _gar_stats_end(&scope, G->counters);
+  if (i < n) {
+    _gar_error(env, fnames[i], "no such file");
+  }
+  qsort(items, n, sizeof(extract_item_t), &compare_item);
+  job.items = items;
+
+  if (nthreads <= 0) {
+    long m = sysconf(_SC_NPROCESSORS_ONLN);
+    nthreads = (m > 0) ? (int)m : 1;
+  }
+  if ((size_t)nthreads > n) {
+    nthreads = (n > 0) ? (int)n : 1;
+  }
+
+  // Run the workers; the calling thread is one of them.
+  threads = _gar_malloc(sizeof(pthread_t) * nthreads, env);
+  while (num_threads < (size_t)nthreads - 1) {
+    if (pthread_create(&threads[num_threads], NULL, &extract_worker, &job)) {
+      break; // the calling thread and the created ones do all.
+    }
+    num_threads++;
+  }
+  extract_worker(&job);
+  for (i = 0; i < num_threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  _gar_free(items);
+  _gar_free(threads);
+  pthread_mutex_destroy(&job.sink_lock);
+
+  // The error message has been displayed by the failed worker.
+  if (job.failed) longjmp(_env, 1);
+
+  return job.result;
+}
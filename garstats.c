@@ -0,0 +1,139 @@
+// garstats.c : count the operations and measure the time of each stage.
+
+#include "garaux.h"
+#include <string.h>
+#include <time.h>
+
+#ifndef GAR_NO_STATS
+
+
+/**
+ * @brief Counters shared by an archive and the streams opened from it.
+ *
+ * The library counts the operations of a call in the calling thread's
+ * counters without any lock, and adds them to the archive's counters and
+ * the aggregate atomically at the end of the call, only if the archive's
+ * statistics are turned on.
+ */
+struct gar_counters {
+  size_t refcnt;
+  int on;
+  gar_stats_t s;
+};
+
+
+#define num_counters (sizeof(gar_stats_t) / sizeof(unsigned long long))
+
+
+__thread gar_tstats_t _gar_tstats;
+
+/// Aggregate of all the archives; whose flag is the default of the archives
+/// opened afterward.
+static gar_counters_t s_total;
+
+
+/// Get the monotonic clock in nanoseconds.
+unsigned long long _gar_clock(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+gar_counters_t *_gar_counters_new(jmp_buf env) {
+  gar_counters_t *C = _gar_malloc_by(_gar_global_allocator(),
+                                     sizeof(gar_counters_t), env);
+  C->refcnt = 1;
+  C->on = __atomic_load_n(&s_total.on, __ATOMIC_RELAXED);
+  memset(&C->s, 0, sizeof(C->s));
+  return C;
+}
+
+
+gar_counters_t *_gar_counters_share(gar_counters_t *C) {
+  if (C != NULL) __atomic_add_fetch(&C->refcnt, 1, __ATOMIC_RELAXED);
+  return C;
+}
+
+
+void _gar_counters_release(gar_counters_t *C) {
+  if (C != NULL && __atomic_sub_fetch(&C->refcnt, 1, __ATOMIC_ACQ_REL) == 0) {
+    _gar_free(C);
+  }
+}
+
+
+gar_counters_t *_gar_counters_total(void) {
+  return &s_total;
+}
+
+
+void _gar_counters_set(gar_counters_t *C, int on) {
+  __atomic_store_n(&C->on, on != 0, __ATOMIC_RELAXED);
+}
+
+
+void _gar_counters_get(const gar_counters_t *C, gar_stats_t *S) {
+  const unsigned long long *src = (const unsigned long long *)&C->s;
+  unsigned long long *dst = (unsigned long long *)S;
+  size_t i;
+
+  for (i = 0; i < num_counters; i++) {
+    dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+  }
+}
+
+
+void _gar_counters_reset(gar_counters_t *C) {
+  unsigned long long *dst = (unsigned long long *)&C->s;
+  size_t i;
+
+  for (i = 0; i < num_counters; i++) {
+    __atomic_store_n(&dst[i], 0, __ATOMIC_RELAXED);
+  }
+}
+
+
+static void flush(gar_counters_t *C, const gar_stats_t *S) {
+  const unsigned long long *src = (const unsigned long long *)S;
+  unsigned long long *dst = (unsigned long long *)&C->s;
+  size_t i;
+
+  for (i = 0; i < num_counters; i++) {
+    if (src[i] != 0) __atomic_add_fetch(&dst[i], src[i], __ATOMIC_RELAXED);
+  }
+}
+
+
+/**
+ * @brief Begin a call measured by the counters @a C (or NULL).
+ *
+ * The calling thread's counters are saved and cleared, so that the nested
+ * calls (e.g. from the callback of gar_enum()) are counted only once. The
+ * call must be ended by _gar_stats_end() also when it is aborted by an
+ * error, so that the counts made before the error are kept and the counters
+ * of the enclosing call are restored.
+ */
+void _gar_stats_begin(gar_stats_scope_t *S, gar_counters_t *C) {
+  S->on = _gar_tstats.on;
+  S->measured = (C != NULL && __atomic_load_n(&C->on, __ATOMIC_RELAXED));
+  if (S->measured) {
+    S->saved = _gar_tstats.s;
+    memset(&_gar_tstats.s, 0, sizeof(gar_stats_t));
+  }
+  _gar_tstats.on = S->measured;
+}
+
+
+/// End a call begun by _gar_stats_begin().
+void _gar_stats_end(gar_stats_scope_t *S, gar_counters_t *C) {
+  if (S->measured) {
+    flush(C, &_gar_tstats.s);
+    flush(&s_total, &_gar_tstats.s);
+    _gar_tstats.s = S->saved;
+  }
+  _gar_tstats.on = S->on;
+}
+
+
+#endif // GAR_NO_STATS
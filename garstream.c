@@ -0,0 +1,496 @@
+// garstream.c : read zipped files forward from a non-seekable stream.
+
+#include "gar.h"
+#include "garlib.h"
+#include "garaux.h"
+#include <string.h>
+
+
+typedef unsigned char byte_t;
+typedef unsigned long u32_t;
+typedef unsigned short u16_t;
+
+
+#define chunk_size 16384 // number of the bytes read from the source at once.
+#define history_size 16 // number of the bytes kept to be pushed back.
+#define unknown_size ((gar_off_t)-1)
+
+
+/**
+ * @brief Forward-only reader of an archive.
+ *
+ * The zipped files are read in the order of the local file headers, without
+ * the central directory, so the archive can be read from a pipe or a socket
+ * as it arrives. The source bytes are buffered by the chunks, and the last
+ * bytes before the current chunk are kept so that the bytes read ahead by
+ * the decompressor can be pushed back.
+ */
+struct gar_stream {
+  gar_gfile_t src; ///< Source stream, which is only read.
+  byte_t buf[history_size + chunk_size];
+  size_t pos; ///< Offset of the next byte in buf.
+  size_t len; ///< Number of the valid bytes in buf.
+  gar_gfile_t data; ///< The current zipped file's data stream.
+  int in_entry; ///< Whether a zipped file is being read.
+  int broken; ///< Whether an error is raised while reading.
+  u16_t flags; ///< General purpose bit flags of the current file.
+  u16_t comp_method;
+  int sized; ///< Whether the compressed size is known before the data.
+  int zip64; ///< Whether the file has the ZIP64 extra field.
+  gar_off_t comp_size; ///< Compressed size.
+  gar_off_t left; ///< Compressed bytes left in the current file.
+  gar_off_t taken; ///< Compressed bytes taken by the data stream.
+  u32_t crc32; ///< Expected CRC-32 value.
+  u32_t crc; ///< CRC-32 value of the read bytes.
+  gar_off_t size; ///< Expected size.
+  gar_off_t out; ///< Number of the read bytes.
+  char *fname;
+  size_t fname_cap;
+  gar_ipool_t *pool; ///< Pool of the decompressors of the zipped files.
+  gar_counters_t *counters;
+};
+
+
+static const char c_err_broken[] = "broken stream";
+static const char c_err_header[] = "broken local file header";
+static const char c_err_descriptor[] = "broken data descriptor";
+static const char c_err_unsupported[] =
+  "stored file of unknown size is not supported";
+
+
+//-----------------------------------------------------------------------------
+// Buffered Input
+
+/// Read the next chunk from the source; the last bytes are kept before it.
+/// @return number of the read bytes, or 0 at the EOF.
+static size_t fill(gar_stream_t *S, jmp_buf env) {
+  size_t keep = (S->len < history_size) ? S->len : history_size;
+  size_t n;
+
+  memmove(S->buf, &S->buf[S->len - keep], keep);
+  S->pos = S->len = keep;
+  n = gar_gfile_read(&S->src, &S->buf[keep], chunk_size, env);
+  S->len += n;
+  return n;
+}
+
+
+/// Read bytes from the buffer.
+/// @return number of the read bytes, which is less than @a n at the EOF.
+static size_t take(gar_stream_t *S, void *ptr, size_t n, jmp_buf env) {
+  byte_t *p = (byte_t *)ptr;
+  size_t nread = 0;
+
+  while (nread < n) {
+    size_t m = S->len - S->pos;
+    if (m == 0) {
+      if (fill(S, env) == 0) break; // reached the EOF.
+      continue;
+    }
+    if (m > n - nread) m = n - nread;
+    memcpy(&p[nread], &S->buf[S->pos], m);
+    S->pos += m;
+    nread += m;
+  }
+
+  return nread;
+}
+
+
+/// Skip bytes of the buffer.
+/// @return number of the skipped bytes, which is less than @a n at the EOF.
+static gar_off_t skip(gar_stream_t *S, gar_off_t n, jmp_buf env) {
+  gar_off_t nskip = 0;
+
+  while (nskip < n) {
+    size_t m = S->len - S->pos;
+    if (m == 0) {
+      if (fill(S, env) == 0) break; // reached the EOF.
+      continue;
+    }
+    if (m > n - nskip) m = (size_t)(n - nskip);
+    S->pos += m;
+    nskip += m;
+  }
+
+  return nskip;
+}
+
+
+//-----------------------------------------------------------------------------
+// Zipped File's Data
+
+/// Read the compressed data of the current file.
+static size_t data_on_read(void *ud, void *ptr, size_t n, jmp_buf env) {
+  gar_stream_t *S = (gar_stream_t *)ud;
+  size_t nread;
+
+  if (n > S->left) n = (size_t)S->left;
+  nread = take(S, ptr, n, env);
+  S->left -= nread;
+  S->taken += nread;
+  return nread;
+}
+
+
+/// View the compressed data of the current file in the buffer; the bytes
+/// of a chunk are viewed at most.
+static const void *data_on_view(void *ud, size_t *n, jmp_buf env) {
+  gar_stream_t *S = (gar_stream_t *)ud;
+  const byte_t *p;
+  size_t m;
+
+  if (S->pos == S->len && S->left > 0) fill(S, env);
+  m = S->len - S->pos;
+  if (m > *n) m = *n;
+  if (m > S->left) m = (size_t)S->left;
+
+  p = &S->buf[S->pos];
+  S->pos += m;
+  S->left -= m;
+  S->taken += m;
+  *n = m;
+  return p;
+}
+
+
+static void data_on_seek(void *ud, gar_off_t off, jmp_buf env) {
+  ((void)ud);
+  ((void)off);
+  _gar_error(env, NULL, "the stream cannot be sought");
+}
+
+
+static gar_off_t data_on_size(void *ud, jmp_buf env) {
+  ((void)ud);
+  _gar_error(env, NULL, "the stream size is unknown");
+}
+
+
+static void data_on_dup(void *ud, gar_gfile_t *dst, jmp_buf env) {
+  ((void)ud);
+  ((void)dst);
+  _gar_error(env, NULL, "the stream cannot be duplicated");
+}
+
+
+static void data_on_close(void *ud) {
+  ((void)ud); // the buffer belongs to the reader.
+}
+
+
+static const gar_gfile_t c_gfile_data = {
+  NULL,
+  &data_on_read,
+  &data_on_view,
+  &data_on_seek,
+  &data_on_size,
+  &data_on_dup,
+  &data_on_close,
+  NULL, // the data is read forward anyway.
+};
+
+
+//-----------------------------------------------------------------------------
+// Zipped Files
+
+static u32_t decode_u32_le(const byte_t s[4]) {
+  return (u32_t)s[0] | ((u32_t)s[1] << 8) | ((u32_t)s[2] << 16) |
+         ((u32_t)s[3] << 24);
+}
+
+
+static u16_t decode_u16_le(const byte_t s[2]) {
+  return (u16_t)(s[0] | (s[1] << 8));
+}
+
+
+static gar_off_t decode_u64_le(const byte_t s[8]) {
+  return decode_u32_le(s) | ((gar_off_t)decode_u32_le(&s[4]) << 32);
+}
+
+
+/// Mask of the sizes in the data descriptor, which are 64-bit only if the
+/// file has the ZIP64 extra field.
+static gar_off_t size_mask(const gar_stream_t *S) {
+  return S->zip64 ? ~(gar_off_t)0 : 0xffffffffUL;
+}
+
+
+/// Check whether the stored data of unknown size is empty, that is, a data
+/// descriptor with the signature follows immediately.
+static int is_empty_data(gar_stream_t *S, jmp_buf env) {
+  byte_t s[4];
+  size_t n = take(S, s, sizeof(s), env);
+  S->pos -= n; // push back; the bytes are in the buffer or its history.
+  return n == sizeof(s) && memcmp(s, "PK\7\10", 4) == 0;
+}
+
+
+/// Read the data descriptor following the data of the current file, whose
+/// signature is optional.
+static void read_descriptor(gar_stream_t *S, jmp_buf env) {
+  byte_t s[24];
+  size_t len = S->zip64 ? 20 : 12; // the sizes are 64-bit with ZIP64.
+  size_t off = 0;
+  gar_off_t comp_size;
+
+  if (take(S, s, len, env) < len) {
+    _gar_error(env, S->fname, c_err_descriptor);
+  }
+  if (memcmp(s, "PK\7\10", 4) == 0) {
+    if (take(S, &s[len], 4, env) < 4) {
+      _gar_error(env, S->fname, c_err_descriptor);
+    }
+    off = 4;
+  }
+
+  S->crc32 = decode_u32_le(&s[off]);
+  if (S->zip64) {
+    comp_size = decode_u64_le(&s[off + 4]);
+    S->size = decode_u64_le(&s[off + 12]);
+  } else {
+    comp_size = decode_u32_le(&s[off + 4]);
+    S->size = decode_u32_le(&s[off + 8]);
+  }
+  if (comp_size != (S->comp_size & size_mask(S))) {
+    _gar_error(env, S->fname, "size mismatch");
+  }
+}
+
+
+/// Close the current file's data, and skip the rest of the compressed data.
+static void close_data(gar_stream_t *S, jmp_buf env) {
+  // Push back the bytes following the deflate data, of which the size is
+  // unknown.
+  if (!S->sized) {
+    size_t n = _gar_inflate_unused(&S->data);
+    S->pos -= n;
+    S->taken -= n;
+    S->comp_size = S->taken;
+    S->left = 0;
+  }
+  gar_gfile_close(&S->data);
+  S->in_entry = 0;
+
+  if (skip(S, S->left, env) < S->left) {
+    _gar_error(env, S->fname, "unexpected EOF");
+  }
+  if (S->flags & 8) read_descriptor(S, env);
+}
+
+
+/// Read bytes from the current file, and verify it at the end.
+static size_t read_data(gar_stream_t *S, void *ptr, size_t n, jmp_buf env) {
+  size_t nread = gar_gfile_read(&S->data, ptr, n, env);
+  unsigned long long t = GAR_STAT_START();
+
+  S->crc = gar_crc32(S->crc, ptr, nread);
+  GAR_STAT_STOP(GAR_STAGE_CRC, t);
+  S->out += nread;
+  if (nread < n) { // reached the end of the file.
+    close_data(S, env);
+    if ((S->out & size_mask(S)) != S->size) {
+      _gar_error(env, S->fname, "size mismatch");
+    }
+    if (S->crc != S->crc32) {
+      _gar_error(env, S->fname, "CRC-32 mismatch");
+    }
+  }
+
+  return nread;
+}
+
+
+/// Skip the rest of the current file.
+static void skip_entry(gar_stream_t *S, jmp_buf env) {
+  byte_t s[4096];
+
+  if (!S->sized) {
+    // The end of the data is known only by decompressing it.
+    while (read_data(S, s, sizeof(s), env) == sizeof(s)) {
+    }
+  } else {
+    close_data(S, env); // the skipped data is not verified.
+  }
+}
+
+
+/// Read the next local file header and open the file's data.
+/// @retval 1  if the next file is found.
+/// @retval 0  if there is no more file.
+static int next_entry(gar_stream_t *S, gar_fstat_t *fstat, jmp_buf env) {
+  byte_t s[30];
+  size_t n;
+  u16_t fname_len;
+  u16_t extra_len;
+  gar_off_t comp_size;
+
+  // The central directory or the EOF ends the zipped files.
+  n = take(S, s, sizeof(s), env);
+  if (n == 0 || (n >= 4 && (memcmp(s, "PK\1\2", 4) == 0 ||
+                            memcmp(s, "PK\5\6", 4) == 0 ||
+                            memcmp(s, "PK\6\6", 4) == 0))) {
+    return 0;
+  }
+  if (n < sizeof(s) || memcmp(s, "PK\3\4", 4) != 0) {
+    _gar_error(env, NULL, c_err_header);
+  }
+  GAR_STAT_ADD(headers, 1);
+
+  S->flags = decode_u16_le(&s[6]);
+  S->comp_method = decode_u16_le(&s[8]);
+  S->crc32 = decode_u32_le(&s[14]);
+  comp_size = decode_u32_le(&s[18]);
+  S->size = decode_u32_le(&s[22]);
+  fname_len = decode_u16_le(&s[26]);
+  extra_len = decode_u16_le(&s[28]);
+
+  // Read the file name and the extra field, which can have the 64-bit sizes.
+  n = (size_t)fname_len + extra_len + 1;
+  if (S->fname_cap < n) {
+    S->fname = _gar_realloc(S->fname, n, env);
+    S->fname_cap = n;
+  }
+  if (take(S, S->fname, n - 1, env) < n - 1) {
+    _gar_error(env, NULL, c_err_header);
+  }
+  S->zip64 = _gar_zip64_extra((const byte_t *)&S->fname[fname_len], extra_len,
+                              &S->size, &comp_size, NULL);
+  S->fname[fname_len] = '\0';
+
+  // The size of the data is given after the data if bit 3 is set; then the
+  // compressed data is read until its end.
+  // An empty stored file is known only by the following data descriptor.
+  S->sized = !((S->flags & 8) && comp_size == 0);
+  if (!S->sized && S->comp_method != 8) {
+    if (!is_empty_data(S, env)) _gar_error(env, S->fname, c_err_unsupported);
+    S->sized = 1;
+  }
+  if (!S->sized) comp_size = unknown_size;
+  S->comp_size = comp_size;
+  S->left = comp_size;
+  S->taken = 0;
+  S->crc = 0;
+  S->out = 0;
+
+  _gar_setup_gfile(&S->data, &c_gfile_data, S);
+  if (S->comp_method == 8) {
+    _gar_inflate(&S->data, S->pool, NULL, env);
+  }
+  S->in_entry = 1;
+
+  fstat->fname = S->fname;
+  fstat->fsize = S->size;
+  return 1;
+}
+
+
+/**
+ * @brief Open the specified (generalized) stream as an archive read forward.
+ *
+ * The stream is only read, neither sought nor duplicated.
+ */
+gar_stream_t *gar_stream_gopen(gar_gfile_t *gf, jmp_buf _env) {
+  jmp_buf env;
+  gar_stream_t *volatile S = NULL;
+
+  if (setjmp(env)) {
+    gar_stream_close(S);
+    longjmp(_env, 1);
+  }
+
+  // Allocate a new gar_stream_t instance and move the specified stream onto
+  // it.
+  S = _gar_malloc(sizeof(gar_stream_t), env);
+  S->src = *gf;
+  S->pos = 0;
+  S->len = 0;
+  gar_gfile_null(&S->data);
+  S->in_entry = 0;
+  S->broken = 0;
+  S->fname = NULL;
+  S->fname_cap = 0;
+  S->pool = NULL;
+  S->counters = NULL;
+  gar_gfile_null(gf); // get the ownership.
+
+  S->pool = _gar_ipool_new(_gar_global_allocator(), env);
+  S->counters = _gar_counters_new(env);
+
+  return S;
+}
+
+
+/**
+ * @brief Go to the next zipped file.
+ *
+ * The rest of the current file is skipped; the file of which the size is
+ * given after the data is decompressed to be skipped. gar_fstat_t::fname is
+ * valid until the next call, and gar_fstat_t::fsize can be 0 if the size is
+ * given after the data.
+ * @retval 1  if the next file is found.
+ * @retval 0  if there is no more file.
+ */
+int gar_stream_next(gar_stream_t *S, gar_fstat_t *fstat, jmp_buf _env) {
+  jmp_buf env;
+  gar_stats_scope_t scope;
+  int found;
+
+  if (S->broken) _gar_error(_env, NULL, c_err_broken);
+  _gar_stats_begin(&scope, S->counters);
+  if (setjmp(env)) {
+    _gar_stats_end(&scope, S->counters);
+    longjmp(_env, 1);
+  }
+  S->broken = 1; // until it succeeds.
+
+  if (S->in_entry) skip_entry(S, env);
+  found = next_entry(S, fstat, env);
+
+  S->broken = 0;
+  _gar_stats_end(&scope, S->counters);
+  return found;
+}
+
+
+/**
+ * @brief Read bytes from the current zipped file.
+ *
+ * The file is verified on reaching its end.
+ * @return number of the read bytes; this value can be less than the specified
+ * if and only if there is no more byte to read (reached the EOF).
+ */
+size_t gar_stream_read(gar_stream_t *S, void *ptr, size_t n, jmp_buf _env) {
+  jmp_buf env;
+  gar_stats_scope_t scope;
+  size_t nread;
+
+  if (S->broken) _gar_error(_env, NULL, c_err_broken);
+  if (!S->in_entry) return 0;
+  _gar_stats_begin(&scope, S->counters);
+  if (setjmp(env)) {
+    _gar_stats_end(&scope, S->counters);
+    longjmp(_env, 1);
+  }
+  S->broken = 1; // until it succeeds.
+
+  nread = read_data(S, ptr, n, env);
+
+  S->broken = 0;
+  _gar_stats_end(&scope, S->counters);
+  return nread;
+}
+
+
+/// Close an archive read forward.
+void gar_stream_close(gar_stream_t *S) {
+  if (S != NULL) {
+    gar_gfile_close(&S->data);
+    gar_gfile_close(&S->src);
+    _gar_ipool_release(S->pool);
+    _gar_counters_release(S->counters);
+    _gar_free(S->fname);
+    _gar_free(S);
+  }
+}
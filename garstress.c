@@ -0,0 +1,303 @@
+// garstress : read zipped files of an archive from many threads at once
+
+#include "gar.h"
+#include "garlib.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/// Zipped file read in advance by the main thread.
+typedef struct expected {
+  char *fname;
+  void *data;
+  size_t len;
+} expected_t;
+
+
+/// Archive and zipped files shared by the threads.
+typedef struct shared {
+  gar_t *G;
+  expected_t *files;
+  int num_files;
+  int num_iters;
+  int failed;
+} shared_t;
+
+
+/// Thread's own state.
+typedef struct worker {
+  shared_t *S;
+  unsigned int seed;
+  pthread_t thread;
+} worker_t;
+
+
+/// Allocator counting the live blocks, installed by the -A option to check
+/// that the library allocates and frees all its memory by the allocator.
+typedef struct counting {
+  size_t calls;
+  size_t blocks;
+  size_t foreign; ///< Blocks given back but not allocated by this allocator.
+} counting_t;
+
+
+#define counting_magic 0x6761725aUL // header of the counted blocks.
+
+
+static void *counting_alloc(void *ud, void *ptr, size_t osize, size_t nsize) {
+  counting_t *C = (counting_t *)ud;
+  unsigned long *b = (ptr != NULL) ? (unsigned long *)ptr - 2 : NULL;
+  ((void)osize);
+
+  __atomic_add_fetch(&C->calls, 1, __ATOMIC_RELAXED);
+  if (b != NULL && b[0] != counting_magic) {
+    __atomic_add_fetch(&C->foreign, 1, __ATOMIC_RELAXED);
+    return NULL;
+  }
+  if (nsize == 0) {
+    if (b != NULL) {
+      b[0] = 0;
+      free(b);
+      __atomic_sub_fetch(&C->blocks, 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+  }
+  b = realloc(b, nsize + 2 * sizeof(unsigned long));
+  if (b == NULL) return NULL;
+  if (ptr == NULL) __atomic_add_fetch(&C->blocks, 1, __ATOMIC_RELAXED);
+  b[0] = counting_magic;
+  return b + 2;
+}
+
+
+static int on_list(const gar_fstat_t *fstat, void *ud, jmp_buf env) {
+  shared_t *S = (shared_t *)ud;
+  expected_t *x;
+
+  S->files = realloc(S->files, sizeof(expected_t) * (S->num_files + 1));
+  if (S->files == NULL) {
+    fprintf(stderr, "out of memory\n");
+    longjmp(env, 1);
+  }
+  x = &S->files[S->num_files++];
+  x->fname = strdup(fstat->fname);
+  x->data = NULL;
+  x->len = 0;
+  if (x->fname == NULL) {
+    fprintf(stderr, "out of memory\n");
+    longjmp(env, 1);
+  }
+  gar_read_all(S->G, x->fname, &x->data, &x->len, env);
+  return 0; // continue enumeration.
+}
+
+
+/// Read a zipped file by the stream and compare it with the expected data;
+/// decompressed ahead by a helper thread if @a async is nonzero.
+static int check_stream(gar_t *G, const expected_t *x, size_t async) {
+  jmp_buf env;
+  gar_fdata_t *volatile fd = NULL;
+  gar_open_opts_t opts;
+  unsigned char s[700];
+  size_t pos = 0;
+  size_t n;
+
+  if (setjmp(env)) {
+    gar_close(fd);
+    return 1;
+  }
+
+  memset(&opts, 0, sizeof(opts));
+  opts.async = async;
+  fd = gar_open_ex(G, x->fname, &opts, env);
+  if (fd == NULL) {
+    fprintf(stderr, "%s: no such file\n", x->fname);
+    longjmp(env, 1);
+  }
+  while ((n = gar_read(fd, s, sizeof(s), env)) > 0) {
+    if (pos + n > x->len || memcmp((char *)x->data + pos, s, n) != 0) {
+      fprintf(stderr, "%s: data mismatch\n", x->fname);
+      longjmp(env, 1);
+    }
+    pos += n;
+  }
+  gar_close(fd);
+
+  return pos != x->len;
+}
+
+
+/// Read a zipped file at once and compare it with the expected data.
+static int check_all(gar_t *G, const expected_t *x) {
+  jmp_buf env;
+  void *volatile buf = NULL;
+  gar_fstat_t fstat;
+  size_t n;
+
+  if (setjmp(env)) {
+    gar_free(buf);
+    return 1;
+  }
+
+  if (!gar_stat(G, x->fname, &fstat, env) || fstat.fsize != x->len ||
+      !gar_read_all(G, x->fname, (void **)&buf, &n, env) || n != x->len ||
+      memcmp(buf, x->data, n) != 0) {
+    fprintf(stderr, "%s: data mismatch\n", x->fname);
+    longjmp(env, 1);
+  }
+  gar_free(buf);
+
+  return 0;
+}
+
+
+/// Read a zipped file ahead by a helper thread, and check that its chunks are
+/// allocated from the arena of the archive.
+static int check_async_arena(gar_t *G, const expected_t *x,
+                             gar_arena_t *arena) {
+  size_t size = gar_arena_size(arena);
+
+  if (check_stream(G, x, 2)) return 1;
+  if (gar_arena_size(arena) - size < 65536) {
+    fprintf(stderr, "the chunks read ahead are not from the arena\n");
+    return 1;
+  }
+  return 0;
+}
+
+
+static void *run_worker(void *arg) {
+  worker_t *W = (worker_t *)arg;
+  shared_t *S = W->S;
+  const expected_t *x;
+  int i;
+
+  for (i = 0; i < S->num_iters; i++) {
+    x = &S->files[rand_r(&W->seed) % S->num_files];
+    if ((i % 2 == 0) ? check_stream(S->G, x, (size_t)(i % 4 / 2)) :
+                       check_all(S->G, x)) {
+      __atomic_store_n(&S->failed, 1, __ATOMIC_RELAXED);
+      break;
+    }
+  }
+
+  return NULL;
+}
+
+
+int main(int argc, char *argv[]) {
+  gar_t *(*open_fn)(const char *, jmp_buf) = &gar_archive_open_file;
+  static shared_t S; // kept across longjmp().
+  static counting_t C;
+  gar_allocator_t A = { &counting_alloc, &C };
+  gar_arena_t *volatile arena = NULL;
+  int use_arena = 0;
+  size_t arena_size = 0;
+  worker_t *W;
+  jmp_buf env;
+  int num_threads;
+  int i;
+
+  // Map the zip archive onto memory if the -m option is given. Allocate the
+  // archive by the counting allocator, and the zipped files by an arena
+  // shared by the threads, if the -A option is given.
+  while (argc > 1 && (strcmp(argv[1], "-m") == 0 ||
+                      strcmp(argv[1], "-A") == 0)) {
+    if (argv[1][1] == 'm') {
+      open_fn = &gar_archive_open_mmap;
+    } else {
+      use_arena = 1;
+    }
+    argv[1] = argv[0];
+    argc--;
+    argv++;
+  }
+
+  if (argc != 4) {
+    fprintf(stderr, "synopsis: %s [-m] [-A] zip-file threads iterations\n",
+            argv[0]);
+    return argc != 1;
+  }
+
+  S.G = NULL;
+  S.files = NULL;
+  S.num_files = 0;
+  S.num_iters = atoi(argv[3]);
+  S.failed = 0;
+  num_threads = atoi(argv[2]);
+
+  if (setjmp(env)) {
+    gar_archive_close(S.G);
+    gar_arena_close(arena);
+    return 1;
+  }
+
+  // Open the archive and read all the zipped files by the main thread; the
+  // statistics are turned on to be updated by all the threads.
+  gar_set_stats(NULL, 1);
+  if (use_arena) {
+    gar_set_allocator(&A);
+    arena = gar_arena_new(4096, env);
+  }
+  S.G = (*open_fn)(argv[1], env);
+  if (arena != NULL) {
+    gar_archive_set_allocator(S.G, gar_arena_allocator(arena));
+  }
+  gar_enum(S.G, &on_list, &S, env);
+  if (arena != NULL) arena_size = gar_arena_size(arena);
+  if (S.num_files == 0 || num_threads <= 0) {
+    longjmp(env, 1);
+  }
+  if (arena != NULL && check_async_arena(S.G, &S.files[0], arena)) {
+    longjmp(env, 1);
+  }
+
+  // Read the zipped files at random by all the threads on the same archive.
+  W = calloc(num_threads, sizeof(worker_t));
+  if (W == NULL) {
+    longjmp(env, 1);
+  }
+  for (i = 0; i < num_threads; i++) {
+    W[i].S = &S;
+    W[i].seed = (unsigned int)i + 1;
+    if (pthread_create(&W[i].thread, NULL, &run_worker, &W[i])) {
+      fprintf(stderr, "cannot create a thread\n");
+      exit(1);
+    }
+  }
+  for (i = 0; i < num_threads; i++) {
+    pthread_join(W[i].thread, NULL);
+  }
+  free(W);
+
+  for (i = 0; i < S.num_files; i++) {
+    free(S.files[i].fname);
+    gar_free(S.files[i].data);
+  }
+  free(S.files);
+  if (arena != NULL && gar_arena_size(arena) <= arena_size) {
+    fprintf(stderr, "the threads did not allocate from the arena\n");
+    S.failed = 1;
+  }
+  gar_archive_close(S.G);
+
+  // All the blocks are freed by the allocator which allocated them.
+  if (arena != NULL) {
+    if (C.calls == 0 || C.blocks != 0 || C.foreign != 0) {
+      fprintf(stderr, "allocator: %lu calls, %lu blocks left, %lu foreign\n",
+              (unsigned long)C.calls, (unsigned long)C.blocks,
+              (unsigned long)C.foreign);
+      S.failed = 1;
+    }
+    gar_arena_reset(arena);
+    if (gar_arena_size(arena) != 0) {
+      fprintf(stderr, "the arena is not reset\n");
+      S.failed = 1;
+    }
+    gar_arena_close(arena);
+  }
+
+  return S.failed;
+}
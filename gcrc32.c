@@ -0,0 +1,236 @@
+// gcrc32.c : calculate CRC-32 (ISO 3309, as used by ZIP).
+
+#include "garlib.h"
+#include "garaux.h"
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+
+//-----------------------------------------------------------------------------
+// Slice-by-8
+
+#define crc32_poly 0xedb88320U // reflected polynomial.
+
+
+static uint32_t c_crc32_table[8][256];
+
+
+/// Fill the lookup tables of slice-by-8.
+static void init_crc32_table(void) {
+  uint32_t i, k, c;
+
+  for (i = 0; i < 256; i++) {
+    c = i;
+    for (k = 0; k < 8; k++) {
+      c = (c & 1) ? (c >> 1) ^ crc32_poly : (c >> 1);
+    }
+    c_crc32_table[0][i] = c;
+  }
+
+  for (i = 0; i < 256; i++) {
+    c = c_crc32_table[0][i];
+    for (k = 1; k < 8; k++) {
+      c = (c >> 8) ^ c_crc32_table[0][c & 0xff];
+      c_crc32_table[k][i] = c;
+    }
+  }
+}
+
+
+/// Load 8 bytes as an unsigned integer of 64bits in little endian.
+static uint64_t load_u64_le(const unsigned char *p) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  uint64_t x;
+  memcpy(&x, p, sizeof(x));
+  return x;
+#else
+  int i;
+  uint64_t x = 0;
+  for (i = 0; i < 8; i++) {
+    x |= (uint64_t)p[i] << (i * 8);
+  }
+  return x;
+#endif
+}
+
+
+/// Update the (pre-conditioned) CRC register by slice-by-8.
+static uint32_t crc32_slice8(uint32_t crc, const unsigned char *p, size_t n) {
+  const uint32_t (*t)[256] = c_crc32_table;
+
+  // Process the leading bytes until the pointer is aligned.
+  while (n > 0 && ((uintptr_t)p & 7) != 0) {
+    crc = t[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    n--;
+  }
+
+  while (n >= 8) {
+    uint64_t w = load_u64_le(p);
+    uint32_t lo = crc ^ (uint32_t)w;
+    uint32_t hi = (uint32_t)(w >> 32);
+    crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^
+          t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+          t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^
+          t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+    p += 8;
+    n -= 8;
+  }
+
+  while (n > 0) {
+    crc = t[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    n--;
+  }
+
+  return crc;
+}
+
+
+//-----------------------------------------------------------------------------
+// PCLMULQDQ Folding (x86-64)
+
+#if defined(__x86_64__)
+
+/**
+ * @brief Update the (pre-conditioned) CRC register by folding with the
+ * carry-less multiplication.
+ *
+ * This is the algorithm of "Fast CRC Computation for Generic Polynomials
+ * Using PCLMULQDQ Instruction" (Intel, 2009) with the bit-reflected
+ * constants of the CRC-32 polynomial. @a n has to be a multiple of 16 and
+ * 64 or more.
+ */
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32_pclmul(uint32_t crc, const unsigned char *p, size_t n) {
+  static const uint64_t k1k2[2] __attribute__((aligned(16))) = {
+    0x0154442bd4ULL, 0x01c6e41596ULL,
+  };
+  static const uint64_t k3k4[2] __attribute__((aligned(16))) = {
+    0x01751997d0ULL, 0x00ccaa009eULL,
+  };
+  static const uint64_t k5k0[2] __attribute__((aligned(16))) = {
+    0x0163cd6124ULL, 0x0000000000ULL,
+  };
+  static const uint64_t poly[2] __attribute__((aligned(16))) = {
+    0x01db710641ULL, 0x01f7011641ULL,
+  };
+  __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+  // Load the first 64 bytes and fold the CRC register into them.
+  x1 = _mm_loadu_si128((const __m128i *)(p + 0x00));
+  x2 = _mm_loadu_si128((const __m128i *)(p + 0x10));
+  x3 = _mm_loadu_si128((const __m128i *)(p + 0x20));
+  x4 = _mm_loadu_si128((const __m128i *)(p + 0x30));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+  x0 = _mm_load_si128((const __m128i *)k1k2);
+  p += 64;
+  n -= 64;
+
+  // Fold 64 bytes at a time in parallel.
+  while (n >= 64) {
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+    x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+    y5 = _mm_loadu_si128((const __m128i *)(p + 0x00));
+    y6 = _mm_loadu_si128((const __m128i *)(p + 0x10));
+    y7 = _mm_loadu_si128((const __m128i *)(p + 0x20));
+    y8 = _mm_loadu_si128((const __m128i *)(p + 0x30));
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+    p += 64;
+    n -= 64;
+  }
+
+  // Fold the four registers into one.
+  x0 = _mm_load_si128((const __m128i *)k3k4);
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+  // Fold the rest 16 bytes at a time.
+  while (n >= 16) {
+    x2 = _mm_loadu_si128((const __m128i *)p);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    p += 16;
+    n -= 16;
+  }
+
+  // Fold 128 bits into 64 bits.
+  x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+  x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+  x1 = _mm_srli_si128(x1, 8);
+  x1 = _mm_xor_si128(x1, x2);
+  x0 = _mm_loadl_epi64((const __m128i *)k5k0);
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, x3);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  // Reduce 64 bits into 32 bits by Barrett reduction.
+  x0 = _mm_load_si128((const __m128i *)poly);
+  x2 = _mm_and_si128(x1, x3);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+  x2 = _mm_and_si128(x2, x3);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+
+#endif
+
+
+//-----------------------------------------------------------------------------
+// Dispatch
+
+static int s_use_pclmul = 0;
+
+
+/// Prepare the tables and select the kernel at the program startup, so that
+/// no lazy initialization runs on the read path.
+__attribute__((constructor))
+static void init_crc32(void) {
+  init_crc32_table();
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  s_use_pclmul = __builtin_cpu_supports("pclmul") &&
+                 __builtin_cpu_supports("sse4.1");
+#endif
+}
+
+
+/// Update the CRC-32 value by the given bytes.
+/// The initial CRC-32 value is 0.
+unsigned long gar_crc32(unsigned long crc, const void *ptr, size_t n) {
+  const unsigned char *p = (const unsigned char *)ptr;
+  uint32_t c = ~(uint32_t)crc;
+
+#if defined(__x86_64__)
+  if (s_use_pclmul && n >= 64) {
+    size_t m = n & ~(size_t)15;
+    c = crc32_pclmul(c, p, m);
+    p += m;
+    n -= m;
+  }
+#endif
+
+  return ~crc32_slice8(c, p, n);
+}
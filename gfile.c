@@ -26,6 +26,14 @@ static size_t gfile_null_on_read(void *ud, void *ptr, size_t n, jmp_buf env) {
 }
 
 
+static const void *gfile_null_on_view(void *ud, size_t *n, jmp_buf env) {
+  ((void)ud);
+  ((void)env);
+  *n = 0;
+  return ""; // emulating empty file.
+}
+
+
 static void gfile_null_on_seek(void *ud, gar_off_t off, jmp_buf env) {
   ((void)ud);
   ((void)off);
@@ -33,6 +41,13 @@ static void gfile_null_on_seek(void *ud, gar_off_t off, jmp_buf env) {
 }
 
 
+static gar_off_t gfile_null_on_size(void *ud, jmp_buf env) {
+  ((void)ud);
+  ((void)env);
+  return 0;
+}
+
+
 static void gfile_null_on_dup(void *ud, gar_gfile_t *dst, jmp_buf env) {
   ((void)ud);
   ((void)env);
@@ -45,12 +60,22 @@ static void gfile_null_on_close(void *ud) {
 }
 
 
+static void gfile_null_on_advise(void *ud, gar_off_t off, gar_off_t len) {
+  ((void)ud);
+  ((void)off);
+  ((void)len);
+}
+
+
 static const gar_gfile_t c_gfile_null = {
   NULL,
   &gfile_null_on_read,
+  &gfile_null_on_view,
   &gfile_null_on_seek,
+  &gfile_null_on_size,
   &gfile_null_on_dup,
   &gfile_null_on_close,
+  &gfile_null_on_advise,
 };
 
 
@@ -58,11 +83,7 @@ static const gar_gfile_t c_gfile_null = {
 /// Null stream emulates an empty file, and does not leak any resource even if
 /// it is not closed.
 void gar_gfile_null(gar_gfile_v *gf) {
-  gf->ud = NULL;
-  gf->read = c_gfile_null.read;
-  gf->seek = c_gfile_null.seek;
-  gf->dup = c_gfile_null.dup;
-  gf->close = c_gfile_null.close;
+  _gar_setup_gfile(gf, &c_gfile_null, NULL);
 }
 
 
@@ -74,6 +95,8 @@ typedef struct gfile_part_ud {
   gar_off_t pos;
   gar_off_t off;
   gar_off_t len;
+  gar_off_t readahead; ///< Bytes advised to be read ahead, or 0.
+  gar_off_t advised; ///< End of the advised bytes.
 } gfile_part_ud_t;
 
 
@@ -82,20 +105,55 @@ static gar_off_t offmin(gar_off_t x, gar_off_t y) {
 }
 
 
+/// Advise the source stream to read ahead the next bytes, once every half of
+/// the read-ahead bytes.
+static void part_readahead(gfile_part_ud_t *pud) {
+  gar_off_t from = (pud->advised > pud->pos) ? pud->advised : pud->pos;
+  gar_off_t to = offmin(pud->pos + pud->readahead, pud->len);
+
+  if (pud->pos + pud->readahead / 2 >= pud->advised && from < to) {
+    gar_gfile_advise(&pud->gf, pud->off + from, to - from);
+    pud->advised = to;
+  }
+}
+
+
 static size_t gfile_part_on_read(void *ud, void *ptr, size_t n, jmp_buf env) {
   gfile_part_ud_t *pud = (gfile_part_ud_t *)ud;
   size_t m = (size_t)offmin(n, pud->len - pud->pos);
-  size_t nread = gar_gfile_read(&pud->gf, ptr, m, env);
+  size_t nread;
+  if (pud->readahead > 0) part_readahead(pud);
+  nread = gar_gfile_read(&pud->gf, ptr, m, env);
   pud->pos += nread;
   return nread;
 }
 
 
+static const void *gfile_part_on_view(void *ud, size_t *n, jmp_buf env) {
+  gfile_part_ud_t *pud = (gfile_part_ud_t *)ud;
+  size_t m = (size_t)offmin(*n, pud->len - pud->pos);
+  const void *ptr = gar_gfile_view(&pud->gf, &m, env);
+  if (ptr != NULL) {
+    pud->pos += m;
+    *n = m;
+  }
+  return ptr;
+}
+
+
 static void gfile_part_on_seek(void *ud, gar_off_t off, jmp_buf env) {
   gfile_part_ud_t *pud = (gfile_part_ud_t *)ud;
   check_off(off, pud->len, env);
   gar_gfile_seek(&pud->gf, pud->off + off, env);
   pud->pos = off;
+  pud->advised = off; // advise again from the new position.
+}
+
+
+static gar_off_t gfile_part_on_size(void *ud, jmp_buf env) {
+  gfile_part_ud_t *pud = (gfile_part_ud_t *)ud;
+  ((void)env);
+  return pud->len;
 }
 
 
@@ -129,13 +187,21 @@ static void gfile_part_on_close(void *ud) {
 }
 
 
+static void gfile_part_on_advise(void *ud, gar_off_t off, gar_off_t len) {
+  gfile_part_ud_t *pud = (gfile_part_ud_t *)ud;
+  if (off < pud->len) {
+    gar_gfile_advise(&pud->gf, pud->off + off, offmin(len, pud->len - off));
+  }
+}
+
+
 static gfile_part_ud_t *gfile_part_on_open(gar_gfile_v *src, gar_off_t off,
                                            gar_off_t len, jmp_buf _env) {
   jmp_buf env;
   gfile_part_ud_t *volatile pud = NULL;
 
   if (setjmp(env)) {
-    gfile_part_on_close(pud);
+    if (pud != NULL) gfile_part_on_close(pud);
     longjmp(_env, 1);
   }
 
@@ -148,6 +214,8 @@ static gfile_part_ud_t *gfile_part_on_open(gar_gfile_v *src, gar_off_t off,
   pud->pos = 0;
   pud->off = off;
   pud->len = len;
+  pud->readahead = 0;
+  pud->advised = 0;
   gar_gfile_null(src); // get the ownership.
 
   return pud;
@@ -157,41 +225,94 @@ static gfile_part_ud_t *gfile_part_on_open(gar_gfile_v *src, gar_off_t off,
 static const gar_gfile_t c_gfile_part = {
   NULL,
   &gfile_part_on_read,
+  &gfile_part_on_view,
   &gfile_part_on_seek,
+  &gfile_part_on_size,
   &gfile_part_on_dup,
   &gfile_part_on_close,
+  &gfile_part_on_advise,
 };
 
 
 /// Open a part of the given stream as a new stream.
 void gar_gfile_open_part(gar_gfile_v *gf, gar_off_t off, gar_off_t len,
                          jmp_buf env) {
-  gf->ud = gfile_part_on_open(gf, off, len, env);
-  gf->read = c_gfile_part.read;
-  gf->seek = c_gfile_part.seek;
-  gf->dup = c_gfile_part.dup;
-  gf->close = c_gfile_part.close;
+  _gar_setup_gfile(gf, &c_gfile_part, gfile_part_on_open(gf, off, len, env));
+}
+
+
+/// Let a partial stream advise its source to read ahead @a n bytes of the
+/// reads (see gar_gfile_advise()), or not if @a n is 0.
+void _gar_gfile_part_readahead(const gar_gfile_t *gf, gar_off_t n) {
+  gfile_part_ud_t *pud = (gfile_part_ud_t *)gf->ud;
+  pud->readahead = n;
+  pud->advised = pud->pos;
 }
 
 
 //-----------------------------------------------------------------------------
 // Methods
 
+/// Set the methods of @a fn and the user data @a ud to the given stream.
+void _gar_setup_gfile(gar_gfile_v *gf, const gar_gfile_t *fn, void *ud) {
+  gf->ud = ud;
+  gf->read = fn->read;
+  gf->view = fn->view;
+  gf->seek = fn->seek;
+  gf->size = fn->size;
+  gf->dup = fn->dup;
+  gf->close = fn->close;
+  gf->advise = fn->advise;
+}
+
+
 size_t gar_gfile_read(const gar_gfile_t *gf, void *ptr, size_t n, jmp_buf env) {
   return gf->read(gf->ud, ptr, n, env);
 }
 
 
+/**
+ * @brief Get the pointer to the next bytes without copying them.
+ *
+ * At most @a *n bytes are viewed and the stream position is advanced by the
+ * number of the viewed bytes, which is stored to @a *n; this number can be
+ * less than the specified if and only if there is no more byte to read.
+ * The viewed bytes are valid until the stream is closed.
+ * @return the pointer to the viewed bytes, or NULL if the stream does not
+ * support viewing (the stream position is not changed in this case).
+ */
+const void *gar_gfile_view(const gar_gfile_t *gf, size_t *n, jmp_buf env) {
+  return gf->view(gf->ud, n, env);
+}
+
+
 void gar_gfile_seek(const gar_gfile_t *gf, gar_off_t off, jmp_buf env) {
   gf->seek(gf->ud, off, env);
 }
 
 
+gar_off_t gar_gfile_size(const gar_gfile_t *gf, jmp_buf env) {
+  return gf->size(gf->ud, env);
+}
+
+
 void gar_gfile_dup(const gar_gfile_t *gf, gar_gfile_t *dst, jmp_buf env) {
   gf->dup(gf->ud, dst, env);
 }
 
 
+/**
+ * @brief Advise that the bytes [@a off, @a off + @a len) will be read soon.
+ *
+ * The stream can start reading them in the background, e.g. by
+ * posix_fadvise(); this is only a hint, which is ignored if the stream does
+ * not support it (the advise method is NULL) or fails.
+ */
+void gar_gfile_advise(const gar_gfile_t *gf, gar_off_t off, gar_off_t len) {
+  if (gf->advise != NULL) gf->advise(gf->ud, off, len);
+}
+
+
 void gar_gfile_close(gar_gfile_v *gf) {
   gf->close(gf->ud);
   gar_gfile_null(gf); // set the closed stream to null.
@@ -0,0 +1,297 @@
+// gfileasync.c : read streams ahead by helper threads.
+
+#include "garlib.h"
+#include "garaux.h"
+#include <pthread.h>
+#include <string.h>
+
+
+#define chunk_size 65536 // bytes read from the source at once.
+
+
+/**
+ * Ring of the chunks read ahead by the helper thread. The helper fills the
+ * chunks after the filled ones, and the reader takes them from the head; a
+ * filled chunk is only touched by the reader until it is taken, so the data
+ * is copied outside the lock.
+ */
+typedef struct gfile_async_ud {
+  gar_gfile_t gf; ///< The source stream.
+  gar_counters_t *counters; ///< Statistics updated by the helper, or NULL.
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t filled; ///< Signaled when a chunk is filled or it stops.
+  pthread_cond_t taken; ///< Signaled when a chunk is taken or it is stopped.
+  unsigned char **chunks;
+  size_t *lens; ///< Bytes of each chunk; less than chunk_size at the EOF.
+  size_t depth; ///< Number of the chunks.
+  size_t head; ///< Index of the chunk to be taken.
+  size_t count; ///< Number of the filled chunks.
+  size_t off; ///< Bytes taken from the head chunk.
+  int eof; ///< Nonzero if the source reached the EOF.
+  int failed; ///< Nonzero if an error is raised by the source.
+  int stop; ///< Nonzero if the helper is asked to stop.
+  int running; ///< Nonzero if the helper thread is running.
+} gfile_async_ud_t;
+
+
+/// Read the next chunk from the source into the free slot @a i; the caller
+/// owns the slot, which is not visible to the other thread until it is
+/// counted.
+static void fill_chunk(gfile_async_ud_t *aud, size_t i, jmp_buf _env) {
+  gar_stats_scope_t scope;
+  jmp_buf env;
+  size_t n = 0;
+  size_t m;
+
+  _gar_stats_begin(&scope, aud->counters);
+  if (setjmp(env)) {
+    _gar_stats_end(&scope, aud->counters);
+    longjmp(_env, 1);
+  }
+
+  // Fill the chunk up, since a short read means the EOF.
+  do {
+    m = gar_gfile_read(&aud->gf, aud->chunks[i] + n, chunk_size - n, env);
+    n += m;
+  } while (m > 0 && n < chunk_size);
+  _gar_stats_end(&scope, aud->counters);
+
+  pthread_mutex_lock(&aud->lock);
+  aud->lens[i] = n;
+  aud->count++;
+  aud->eof = n < chunk_size;
+  pthread_cond_signal(&aud->filled);
+  pthread_mutex_unlock(&aud->lock);
+}
+
+
+/// Fill the free chunks until the EOF, an error or the stop request.
+static void *async_helper(void *arg) {
+  gfile_async_ud_t *aud = (gfile_async_ud_t *)arg;
+  jmp_buf env;
+  size_t i;
+
+  // The error message has been displayed; the reader raises the error again.
+  if (setjmp(env)) {
+    pthread_mutex_lock(&aud->lock);
+    aud->failed = 1;
+    pthread_cond_signal(&aud->filled);
+    pthread_mutex_unlock(&aud->lock);
+    return NULL;
+  }
+
+  for (;;) {
+    pthread_mutex_lock(&aud->lock);
+    while (aud->count == aud->depth && !aud->stop) {
+      pthread_cond_wait(&aud->taken, &aud->lock);
+    }
+    if (aud->stop || aud->eof) {
+      pthread_mutex_unlock(&aud->lock);
+      break;
+    }
+    i = (aud->head + aud->count) % aud->depth;
+    pthread_mutex_unlock(&aud->lock);
+
+    fill_chunk(aud, i, env);
+  }
+
+  return NULL;
+}
+
+
+/// Stop the helper thread if running; the filled chunks are kept, and the
+/// source stream is left after them.
+static void stop_helper(gfile_async_ud_t *aud) {
+  if (aud->running) {
+    pthread_mutex_lock(&aud->lock);
+    aud->stop = 1;
+    pthread_cond_signal(&aud->taken);
+    pthread_mutex_unlock(&aud->lock);
+    pthread_join(aud->thread, NULL);
+    aud->stop = 0;
+    aud->running = 0;
+  }
+}
+
+
+static size_t gfile_async_on_read(void *ud, void *ptr, size_t n,
+                                  jmp_buf env) {
+  gfile_async_ud_t *aud = (gfile_async_ud_t *)ud;
+  size_t nread = 0;
+  size_t m;
+
+  while (nread < n) {
+    pthread_mutex_lock(&aud->lock);
+    if (aud->count == 0 && !aud->eof && !aud->failed && !aud->running) {
+      // Start the helper on demand; read by itself if no thread is available.
+      if (pthread_create(&aud->thread, NULL, &async_helper, aud) == 0) {
+        aud->running = 1;
+      } else {
+        pthread_mutex_unlock(&aud->lock);
+        fill_chunk(aud, aud->head, env);
+        continue;
+      }
+    }
+    while (aud->count == 0 && !aud->eof && !aud->failed) {
+      pthread_cond_wait(&aud->filled, &aud->lock);
+    }
+    if (aud->count == 0) {
+      pthread_mutex_unlock(&aud->lock);
+      // The error message has been displayed by the helper thread.
+      if (aud->failed) longjmp(env, 1);
+      break; // EOF.
+    }
+    pthread_mutex_unlock(&aud->lock);
+
+    // Copy from the head chunk, which the helper does not touch.
+    m = aud->lens[aud->head] - aud->off;
+    if (m > n - nread) m = n - nread;
+    memcpy((unsigned char *)ptr + nread, aud->chunks[aud->head] + aud->off, m);
+    nread += m;
+    aud->off += m;
+
+    if (aud->off == aud->lens[aud->head]) {
+      pthread_mutex_lock(&aud->lock);
+      aud->head = (aud->head + 1) % aud->depth;
+      aud->count--;
+      aud->off = 0;
+      pthread_cond_signal(&aud->taken);
+      pthread_mutex_unlock(&aud->lock);
+    }
+  }
+
+  return nread;
+}
+
+
+static const void *gfile_async_on_view(void *ud, size_t *n, jmp_buf env) {
+  ((void)ud);
+  ((void)n);
+  ((void)env);
+  return NULL; // not supported, since the chunks are reused.
+}
+
+
+static void gfile_async_on_seek(void *ud, gar_off_t off, jmp_buf env) {
+  gfile_async_ud_t *aud = (gfile_async_ud_t *)ud;
+
+  // Discard the chunks read ahead, and restart from the source's offset.
+  stop_helper(aud);
+  aud->head = 0;
+  aud->count = 0;
+  aud->off = 0;
+  aud->eof = 0;
+  aud->failed = 0;
+  gar_gfile_seek(&aud->gf, off, env);
+}
+
+
+static gar_off_t gfile_async_on_size(void *ud, jmp_buf env) {
+  gfile_async_ud_t *aud = (gfile_async_ud_t *)ud;
+  stop_helper(aud); // the source is not used concurrently.
+  return gar_gfile_size(&aud->gf, env);
+}
+
+
+static void gfile_async_on_dup(void *ud, gar_gfile_t *dst, jmp_buf env) {
+  ((void)ud);
+  ((void)dst);
+  _gar_error(env, NULL, "the stream cannot be duplicated");
+}
+
+
+static void gfile_async_on_close(void *ud) {
+  gfile_async_ud_t *aud = (gfile_async_ud_t *)ud;
+  size_t i;
+
+  stop_helper(aud);
+  pthread_cond_destroy(&aud->taken);
+  pthread_cond_destroy(&aud->filled);
+  pthread_mutex_destroy(&aud->lock);
+  for (i = 0; i < aud->depth; i++) {
+    _gar_free(aud->chunks[i]);
+  }
+  _gar_free(aud->chunks);
+  _gar_free(aud->lens);
+  gar_gfile_close(&aud->gf);
+  _gar_counters_release(aud->counters);
+  _gar_free(aud);
+}
+
+
+static gfile_async_ud_t *gfile_async_on_open(gar_gfile_v *src, size_t depth,
+                                             gar_counters_t *C,
+                                             jmp_buf _env) {
+  jmp_buf env;
+  gfile_async_ud_t *volatile aud = NULL;
+
+  if (setjmp(env)) {
+    if (aud != NULL) gfile_async_on_close(aud);
+    longjmp(_env, 1);
+  }
+
+  if (depth == 0) depth = 2; // double buffering.
+
+  aud = _gar_malloc(sizeof(gfile_async_ud_t), env);
+  gar_gfile_null(&aud->gf);
+  aud->counters = NULL;
+  aud->chunks = NULL;
+  aud->lens = NULL;
+  aud->depth = 0;
+  aud->head = 0;
+  aud->count = 0;
+  aud->off = 0;
+  aud->eof = 0;
+  aud->failed = 0;
+  aud->stop = 0;
+  aud->running = 0;
+  pthread_mutex_init(&aud->lock, NULL);
+  pthread_cond_init(&aud->filled, NULL);
+  pthread_cond_init(&aud->taken, NULL);
+
+  aud->lens = _gar_malloc(sizeof(size_t) * depth, env);
+  aud->chunks = _gar_malloc(sizeof(unsigned char *) * depth, env);
+  for (; aud->depth < depth; aud->depth++) {
+    aud->chunks[aud->depth] = _gar_malloc(chunk_size, env);
+  }
+
+  aud->counters = _gar_counters_share(C);
+  aud->gf = *src;
+  gar_gfile_null(src); // get the ownership.
+
+  return aud;
+}
+
+
+static const gar_gfile_t c_gfile_async = {
+  NULL,
+  &gfile_async_on_read,
+  &gfile_async_on_view,
+  &gfile_async_on_seek,
+  &gfile_async_on_size,
+  &gfile_async_on_dup,
+  &gfile_async_on_close,
+  NULL, // the source is read ahead already.
+};
+
+
+/// Read the given stream ahead by a helper thread with the statistics @a C
+/// (can be NULL); see gar_gfile_open_async().
+void _gar_gfile_async(gar_gfile_v *gf, size_t depth, gar_counters_t *C,
+                      jmp_buf env) {
+  _gar_setup_gfile(gf, &c_gfile_async, gfile_async_on_open(gf, depth, C, env));
+}
+
+
+/**
+ * @brief Read the given stream ahead by a helper thread.
+ *
+ * The helper thread is started by the first read, and reads @a depth chunks
+ * of 64KB (2 if 0) ahead of the reads; an error raised by the source is
+ * displayed by the helper, and raised again by the next read. Seeking the
+ * stream discards the chunks read ahead. The stream cannot be duplicated.
+ */
+void gar_gfile_open_async(gar_gfile_v *gf, size_t depth, jmp_buf env) {
+  _gar_gfile_async(gf, depth, NULL, env);
+}
@@ -1,34 +1,19 @@
 // gfilecrt.c : manipulate files via the C runtime.
 
-#include "gar.h"
+#define _FILE_OFFSET_BITS 64
+
 #include "garlib.h"
 #include "garaux.h"
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
-
-
-gar_t *gar_archive_open_file(const char *fname, jmp_buf _env) {
-  jmp_buf env;
-  gar_gfile_t gf;
-  gar_gfile_null(&gf);
-
-  if (setjmp(env)) {
-    gar_gfile_close(&gf);
-    longjmp(_env, 1);
-  }
-
-  // Open the specified file.
-  gar_gfile_open_file(&gf, fname, env);
-
-  // Open the file as an archive.
-  return gar_archive_gopen(&gf, env);
-}
+#include <sys/types.h>
 
 
 typedef struct gfile_file_ud {
   FILE *fp;
-  long fsize;
+  gar_off_t fsize;
   char fname[1];
 } gfile_file_ud_t;
 
@@ -40,22 +25,44 @@ static void _gar_perror(jmp_buf env, const char *pre) {
 
 static size_t gfile_file_on_read(void *ud, void *ptr, size_t n, jmp_buf env) {
   gfile_file_ud_t *fud = (gfile_file_ud_t *)ud;
+  unsigned long long t = GAR_STAT_START();
   size_t nread = fread(ptr, 1, n, fud->fp);
   if (nread < n && ferror(fud->fp)) { _gar_perror(env, fud->fname); }
+  GAR_STAT_ADD(read_calls, 1);
+  GAR_STAT_ADD(read_bytes, nread);
+  GAR_STAT_STOP(GAR_STAGE_IO, t);
   return nread;
 }
 
 
+static const void *gfile_file_on_view(void *ud, size_t *n, jmp_buf env) {
+  ((void)ud);
+  ((void)n);
+  ((void)env);
+  return NULL; // not supported.
+}
+
+
 static void gfile_file_on_seek(void *ud, gar_off_t off, jmp_buf env) {
   gfile_file_ud_t *fud = (gfile_file_ud_t *)ud;
 
   // Make sure that the specified seek offset is inside of the source file
-  // data and that the given offset can be safely casted into (long).
-  if (off > (unsigned long)fud->fsize) {
+  // data and that the given offset can be safely casted into (off_t).
+  if (off > fud->fsize) {
     _gar_error(env, fud->fname, "out-of-range seek offset");
   }
 
-  if (fseek(fud->fp, (long)off, SEEK_SET)) { _gar_perror(env, fud->fname); }
+  if (fseeko(fud->fp, (off_t)off, SEEK_SET)) {
+    _gar_perror(env, fud->fname);
+  }
+  GAR_STAT_ADD(seeks, 1);
+}
+
+
+static gar_off_t gfile_file_on_size(void *ud, jmp_buf env) {
+  gfile_file_ud_t *fud = (gfile_file_ud_t *)ud;
+  ((void)env);
+  return fud->fsize;
 }
 
 
@@ -67,23 +74,33 @@ static void gfile_file_on_dup(void *ud, gar_gfile_t *dst, jmp_buf env) {
 
 static void gfile_file_on_close(void *ud) {
   gfile_file_ud_t *fud = (gfile_file_ud_t *)ud;
-  if (fud->fp != NULL) fclose(fud->fp);
+  if (fud != NULL && fud->fp != NULL) fclose(fud->fp);
   _gar_free(fud);
 }
 
 
+static void gfile_file_on_advise(void *ud, gar_off_t off, gar_off_t len) {
+  gfile_file_ud_t *fud = (gfile_file_ud_t *)ud;
+  posix_fadvise(fileno(fud->fp), (off_t)off, (off_t)len, POSIX_FADV_WILLNEED);
+}
+
+
 static const gar_gfile_t c_gfile_file = {
   NULL,
   &gfile_file_on_read,
+  &gfile_file_on_view,
   &gfile_file_on_seek,
+  &gfile_file_on_size,
   &gfile_file_on_dup,
   &gfile_file_on_close,
+  &gfile_file_on_advise,
 };
 
 
 static gfile_file_ud_t *gfile_file_on_open(const char *fname, jmp_buf _env) {
   jmp_buf env;
-  gfile_file_ud_t *fud = NULL;
+  gfile_file_ud_t *volatile fud = NULL;
+  off_t fsize;
 
   if (setjmp(env)) {
     gfile_file_on_close(fud);
@@ -92,16 +109,17 @@ static gfile_file_ud_t *gfile_file_on_open(const char *fname, jmp_buf _env) {
 
   fud = _gar_malloc(offsetof(gfile_file_ud_t, fname) + strlen(fname) + 1, env);
   fud->fp = NULL;
-  fud->fsize = -1;
+  fud->fsize = 0;
   strcpy(fud->fname, fname);
 
   if ((fud->fp = fopen(fname, "rb")) == NULL) { _gar_perror(env, fname); }
 
-  if (fseek(fud->fp, 0, SEEK_END) ||
-      (fud->fsize = ftell(fud->fp)) == -1 ||
-      fseek(fud->fp, 0, SEEK_SET)) {
+  if (fseeko(fud->fp, 0, SEEK_END) ||
+      (fsize = ftello(fud->fp)) == -1 ||
+      fseeko(fud->fp, 0, SEEK_SET)) {
     _gar_perror(env, fname);
   }
+  fud->fsize = (gar_off_t)fsize;
 
   return fud;
 }
@@ -109,9 +127,64 @@ static gfile_file_ud_t *gfile_file_on_open(const char *fname, jmp_buf _env) {
 
 /// Open the specified file.
 void gar_gfile_open_file(gar_gfile_v *gf, const char *fname, jmp_buf env) {
-  gf->ud = gfile_file_on_open(fname, env);
-  gf->read = c_gfile_file.read;
-  gf->seek = c_gfile_file.seek;
-  gf->dup = c_gfile_file.dup;
-  gf->close = c_gfile_file.close;
+  _gar_setup_gfile(gf, &c_gfile_file, gfile_file_on_open(fname, env));
+}
+
+
+//-----------------------------------------------------------------------------
+// Stream of FILE
+
+static void gfile_fp_on_seek(void *ud, gar_off_t off, jmp_buf env) {
+  gfile_file_ud_t *fud = (gfile_file_ud_t *)ud;
+  ((void)off);
+  _gar_error(env, fud->fname, "the stream cannot be sought");
+}
+
+
+static gar_off_t gfile_fp_on_size(void *ud, jmp_buf env) {
+  gfile_file_ud_t *fud = (gfile_file_ud_t *)ud;
+  _gar_error(env, fud->fname, "the stream size is unknown");
+}
+
+
+static void gfile_fp_on_dup(void *ud, gar_gfile_t *dst, jmp_buf env) {
+  gfile_file_ud_t *fud = (gfile_file_ud_t *)ud;
+  ((void)dst);
+  _gar_error(env, fud->fname, "the stream cannot be duplicated");
+}
+
+
+static void gfile_fp_on_close(void *ud) {
+  _gar_free(ud); // the FILE is closed by the caller.
+}
+
+
+static const gar_gfile_t c_gfile_fp = {
+  NULL,
+  &gfile_file_on_read,
+  &gfile_file_on_view,
+  &gfile_fp_on_seek,
+  &gfile_fp_on_size,
+  &gfile_fp_on_dup,
+  &gfile_fp_on_close,
+  NULL, // nothing can be read ahead of the stream.
+};
+
+
+/**
+ * @brief Open a stream reading the given FILE forward, e.g. stdin.
+ *
+ * The stream can be neither sought nor duplicated, so it is meant for
+ * gar_stream_gopen(). The FILE is not closed by the stream; @a fname is the
+ * name in the error messages.
+ */
+void gar_gfile_open_fp(gar_gfile_v *gf, FILE *fp, const char *fname,
+                       jmp_buf env) {
+  gfile_file_ud_t *fud;
+
+  fud = _gar_malloc(offsetof(gfile_file_ud_t, fname) + strlen(fname) + 1, env);
+  fud->fp = fp;
+  fud->fsize = 0; // unknown.
+  strcpy(fud->fname, fname);
+  _gar_setup_gfile(gf, &c_gfile_fp, fud);
 }
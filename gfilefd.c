@@ -0,0 +1,189 @@
+// gfilefd.c : manipulate files via file descriptors (POSIX).
+
+#define _FILE_OFFSET_BITS 64
+
+#include "gar.h"
+#include "garlib.h"
+#include "garaux.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+gar_t *gar_archive_open_file(const char *fname, jmp_buf _env) {
+  jmp_buf env;
+  gar_gfile_t gf;
+  gar_gfile_null(&gf);
+
+  if (setjmp(env)) {
+    gar_gfile_close(&gf);
+    longjmp(_env, 1);
+  }
+
+  // Open the specified file.
+  gar_gfile_open_fd(&gf, fname, env);
+
+  // Open the file as an archive.
+  return gar_archive_gopen(&gf, env);
+}
+
+
+/// File descriptor shared by the duplicated streams; they can be used (and
+/// closed) by different threads, so the reference count is atomic.
+typedef struct gfile_fd {
+  size_t refcnt;
+  int fd;
+  gar_off_t fsize;
+  char fname[1];
+} gfile_fd_t;
+
+
+typedef struct gfile_fd_ud {
+  gfile_fd_t *file;
+  gar_off_t pos;
+} gfile_fd_ud_t;
+
+
+static void _gar_perror(jmp_buf env, const char *pre) {
+  _gar_error(env, pre, strerror(errno));
+}
+
+
+static void release_fd(gfile_fd_t *file) {
+  if (__atomic_sub_fetch(&file->refcnt, 1, __ATOMIC_ACQ_REL) == 0) {
+    if (file->fd != -1) close(file->fd);
+    _gar_free(file);
+  }
+}
+
+
+/// Open a new stream on the given file descriptor.
+static gfile_fd_ud_t *gfile_fd_on_share(gfile_fd_t *file, jmp_buf env) {
+  gfile_fd_ud_t *fud = _gar_malloc(sizeof(gfile_fd_ud_t), env);
+  fud->file = file;
+  fud->pos = 0;
+  __atomic_add_fetch(&file->refcnt, 1, __ATOMIC_RELAXED);
+  return fud;
+}
+
+
+static size_t gfile_fd_on_read(void *ud, void *ptr, size_t n, jmp_buf env) {
+  gfile_fd_ud_t *fud = (gfile_fd_ud_t *)ud;
+  size_t nread = 0;
+  unsigned long long t = GAR_STAT_START();
+
+  // Each stream has its own position, so the shared file descriptor's one
+  // is never used.
+  while (nread < n) {
+    ssize_t m = pread(fud->file->fd, (char *)ptr + nread, n - nread,
+                      (off_t)fud->pos);
+    GAR_STAT_ADD(read_calls, 1);
+    if (m == -1) {
+      if (errno == EINTR) continue;
+      _gar_perror(env, fud->file->fname);
+    }
+    if (m == 0) break; // reached the EOF.
+    nread += (size_t)m;
+    fud->pos += (size_t)m;
+  }
+
+  GAR_STAT_ADD(read_bytes, nread);
+  GAR_STAT_STOP(GAR_STAGE_IO, t);
+  return nread;
+}
+
+
+static const void *gfile_fd_on_view(void *ud, size_t *n, jmp_buf env) {
+  ((void)ud);
+  ((void)n);
+  ((void)env);
+  return NULL; // not supported.
+}
+
+
+static void gfile_fd_on_seek(void *ud, gar_off_t off, jmp_buf env) {
+  gfile_fd_ud_t *fud = (gfile_fd_ud_t *)ud;
+  if (off > fud->file->fsize) {
+    _gar_error(env, fud->file->fname, "out-of-range seek offset");
+  }
+  fud->pos = off;
+  GAR_STAT_ADD(seeks, 1);
+}
+
+
+static gar_off_t gfile_fd_on_size(void *ud, jmp_buf env) {
+  gfile_fd_ud_t *fud = (gfile_fd_ud_t *)ud;
+  ((void)env);
+  return fud->file->fsize;
+}
+
+
+static void gfile_fd_on_dup(void *ud, gar_gfile_t *dst, jmp_buf env);
+
+
+static void gfile_fd_on_close(void *ud) {
+  gfile_fd_ud_t *fud = (gfile_fd_ud_t *)ud;
+  release_fd(fud->file);
+  _gar_free(fud);
+}
+
+
+static void gfile_fd_on_advise(void *ud, gar_off_t off, gar_off_t len) {
+  gfile_fd_ud_t *fud = (gfile_fd_ud_t *)ud;
+  posix_fadvise(fud->file->fd, (off_t)off, (off_t)len, POSIX_FADV_WILLNEED);
+}
+
+
+static const gar_gfile_t c_gfile_fd = {
+  NULL,
+  &gfile_fd_on_read,
+  &gfile_fd_on_view,
+  &gfile_fd_on_seek,
+  &gfile_fd_on_size,
+  &gfile_fd_on_dup,
+  &gfile_fd_on_close,
+  &gfile_fd_on_advise,
+};
+
+
+static void gfile_fd_on_dup(void *ud, gar_gfile_t *dst, jmp_buf env) {
+  gfile_fd_ud_t *fud = (gfile_fd_ud_t *)ud;
+  _gar_setup_gfile(dst, &c_gfile_fd, gfile_fd_on_share(fud->file, env));
+}
+
+
+static gfile_fd_ud_t *gfile_fd_on_open(const char *fname, jmp_buf _env) {
+  jmp_buf env;
+  gfile_fd_t *volatile file = NULL;
+  struct stat st;
+
+  if (setjmp(env)) {
+    if (file != NULL) {
+      if (file->fd != -1) close(file->fd);
+      _gar_free(file);
+    }
+    longjmp(_env, 1);
+  }
+
+  file = _gar_malloc(offsetof(gfile_fd_t, fname) + strlen(fname) + 1, env);
+  file->refcnt = 0;
+  file->fd = -1;
+  file->fsize = 0;
+  strcpy(file->fname, fname);
+
+  if ((file->fd = open(fname, O_RDONLY)) == -1) { _gar_perror(env, fname); }
+  if (fstat(file->fd, &st) == -1) { _gar_perror(env, fname); }
+  file->fsize = (gar_off_t)st.st_size;
+
+  return gfile_fd_on_share(file, env);
+}
+
+
+/// Open the specified file.
+/// The file descriptor is shared by the duplicated streams, each of which
+/// reads the file at its own position by pread().
+void gar_gfile_open_fd(gar_gfile_v *gf, const char *fname, jmp_buf env) {
+  _gar_setup_gfile(gf, &c_gfile_fd, gfile_fd_on_open(fname, env));
+}
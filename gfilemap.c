@@ -0,0 +1,74 @@
+// gfilemap.c : map files onto memory (POSIX).
+
+#include "gar.h"
+#include "garlib.h"
+#include "garaux.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+gar_t *gar_archive_open_mmap(const char *fname, jmp_buf _env) {
+  jmp_buf env;
+  gar_gfile_t gf;
+  gar_gfile_null(&gf);
+
+  if (setjmp(env)) {
+    gar_gfile_close(&gf);
+    longjmp(_env, 1);
+  }
+
+  // Map the specified file.
+  gar_gfile_open_mmap(&gf, fname, env);
+
+  // Open the file as an archive.
+  return gar_archive_gopen(&gf, env);
+}
+
+
+static void _gar_perror(jmp_buf env, const char *pre) {
+  _gar_error(env, pre, strerror(errno));
+}
+
+
+static void unmap(void *ptr, size_t len) {
+  if (len > 0) munmap(ptr, len);
+}
+
+
+/// Map the specified file onto memory and open it.
+/// The mapping is shared by the duplicated streams.
+void gar_gfile_open_mmap(gar_gfile_v *gf, const char *fname, jmp_buf _env) {
+  jmp_buf env;
+  volatile int fd = -1;
+  struct stat st;
+  void *ptr = NULL;
+
+  if (setjmp(env)) {
+    if (fd != -1) close(fd);
+    longjmp(_env, 1);
+  }
+
+  if ((fd = open(fname, O_RDONLY)) == -1) { _gar_perror(env, fname); }
+  if (fstat(fd, &st) == -1) { _gar_perror(env, fname); }
+
+  // Make sure that the whole file can be mapped.
+  if ((gar_off_t)st.st_size > (size_t)-1) {
+    _gar_error(env, fname, "too large file to map");
+  }
+
+  // Map the whole file; mmap() rejects the zero length.
+  if (st.st_size > 0) {
+    ptr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (ptr == MAP_FAILED) { _gar_perror(env, fname); }
+  }
+
+  // The mapping remains after closing the file descriptor.
+  close(fd);
+  fd = -1;
+
+  gar_gfile_open_memory(gf, ptr, (size_t)st.st_size, &unmap, env);
+}
@@ -0,0 +1,172 @@
+// gfilemem.c : manipulate byte strings on memory as files.
+
+#include "gar.h"
+#include "garlib.h"
+#include "garaux.h"
+#include <string.h>
+
+
+gar_t *gar_archive_open_memory(const void *ptr, size_t len,
+                               gar_release_t release, jmp_buf _env) {
+  jmp_buf env;
+  gar_gfile_t gf;
+  gar_gfile_null(&gf);
+
+  if (setjmp(env)) {
+    gar_gfile_close(&gf);
+    longjmp(_env, 1);
+  }
+
+  // Open the specified byte string.
+  gar_gfile_open_memory(&gf, ptr, len, release, env);
+
+  // Open the byte string as an archive.
+  return gar_archive_gopen(&gf, env);
+}
+
+
+/// Byte string shared by the duplicated streams; they can be used (and
+/// closed) by different threads, so the reference count is atomic.
+typedef struct gfile_mem {
+  size_t refcnt;
+  const unsigned char *ptr; ///< Base of the reads; non-NULL even if empty.
+  size_t len;
+  gar_release_t release;
+  void *given; ///< The caller's pointer given back to the release function.
+} gfile_mem_t;
+
+
+typedef struct gfile_mem_ud {
+  gfile_mem_t *mem;
+  size_t pos;
+} gfile_mem_ud_t;
+
+
+static void release_mem(gfile_mem_t *mem) {
+  if (__atomic_sub_fetch(&mem->refcnt, 1, __ATOMIC_ACQ_REL) == 0) {
+    if (mem->release != NULL) (*mem->release)(mem->given, mem->len);
+    _gar_free(mem);
+  }
+}
+
+
+/// Open a new stream on the given byte string.
+static gfile_mem_ud_t *gfile_mem_on_share(gfile_mem_t *mem, jmp_buf env) {
+  gfile_mem_ud_t *mud = _gar_malloc(sizeof(gfile_mem_ud_t), env);
+  mud->mem = mem;
+  mud->pos = 0;
+  __atomic_add_fetch(&mem->refcnt, 1, __ATOMIC_RELAXED);
+  return mud;
+}
+
+
+static size_t gfile_mem_on_read(void *ud, void *ptr, size_t n, jmp_buf env) {
+  gfile_mem_ud_t *mud = (gfile_mem_ud_t *)ud;
+  size_t m = mud->mem->len - mud->pos;
+  unsigned long long t = GAR_STAT_START();
+  ((void)env);
+  if (n > m) n = m;
+  memcpy(ptr, &mud->mem->ptr[mud->pos], n);
+  mud->pos += n;
+  GAR_STAT_ADD(read_calls, 1);
+  GAR_STAT_ADD(read_bytes, n);
+  GAR_STAT_STOP(GAR_STAGE_IO, t);
+  return n;
+}
+
+
+static const void *gfile_mem_on_view(void *ud, size_t *n, jmp_buf env) {
+  gfile_mem_ud_t *mud = (gfile_mem_ud_t *)ud;
+  size_t m = mud->mem->len - mud->pos;
+  const unsigned char *p = &mud->mem->ptr[mud->pos];
+  ((void)env);
+  if (*n > m) *n = m;
+  mud->pos += *n;
+  GAR_STAT_ADD(read_calls, 1);
+  GAR_STAT_ADD(read_bytes, *n);
+  return p;
+}
+
+
+static void gfile_mem_on_seek(void *ud, gar_off_t off, jmp_buf env) {
+  gfile_mem_ud_t *mud = (gfile_mem_ud_t *)ud;
+  if (off > mud->mem->len) {
+    _gar_error(env, NULL, "out-of-range seek offset");
+  }
+  mud->pos = (size_t)off;
+  GAR_STAT_ADD(seeks, 1);
+}
+
+
+static gar_off_t gfile_mem_on_size(void *ud, jmp_buf env) {
+  gfile_mem_ud_t *mud = (gfile_mem_ud_t *)ud;
+  ((void)env);
+  return mud->mem->len;
+}
+
+
+static void gfile_mem_on_dup(void *ud, gar_gfile_t *dst, jmp_buf env);
+
+
+static void gfile_mem_on_close(void *ud) {
+  gfile_mem_ud_t *mud = (gfile_mem_ud_t *)ud;
+  release_mem(mud->mem);
+  _gar_free(mud);
+}
+
+
+static const gar_gfile_t c_gfile_mem = {
+  NULL,
+  &gfile_mem_on_read,
+  &gfile_mem_on_view,
+  &gfile_mem_on_seek,
+  &gfile_mem_on_size,
+  &gfile_mem_on_dup,
+  &gfile_mem_on_close,
+  NULL, // the bytes are on memory.
+};
+
+
+static void gfile_mem_on_dup(void *ud, gar_gfile_t *dst, jmp_buf env) {
+  gfile_mem_ud_t *mud = (gfile_mem_ud_t *)ud;
+  _gar_setup_gfile(dst, &c_gfile_mem, gfile_mem_on_share(mud->mem, env));
+}
+
+
+static gfile_mem_ud_t *gfile_mem_on_open(const void *ptr, size_t len,
+                                         gar_release_t release,
+                                         jmp_buf _env) {
+  jmp_buf env;
+  gfile_mem_t *volatile mem = NULL;
+
+  if (setjmp(env)) {
+    if (release != NULL) (*release)((void *)ptr, len);
+    _gar_free(mem);
+    longjmp(_env, 1);
+  }
+
+  mem = _gar_malloc(sizeof(gfile_mem_t), env);
+  mem->refcnt = 0;
+  mem->ptr = (ptr != NULL) ? (const unsigned char *)ptr
+                           : (const unsigned char *)"";
+  mem->len = len;
+  mem->release = release;
+  mem->given = (void *)ptr;
+
+  return gfile_mem_on_share(mem, env);
+}
+
+
+/**
+ * @brief Open the given byte string as a file.
+ *
+ * The byte string is not copied, and has to be valid until all the opened
+ * and the duplicated streams are closed; then @a release is called with
+ * @a ptr and @a len unless it is NULL.
+ * @a release is also called if this function fails.
+ */
+void gar_gfile_open_memory(gar_gfile_v *gf, const void *ptr, size_t len,
+                           gar_release_t release, jmp_buf env) {
+  _gar_setup_gfile(gf, &c_gfile_mem,
+                   gfile_mem_on_open(ptr, len, release, env));
+}
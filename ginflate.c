@@ -2,7 +2,9 @@
 
 #include "garlib.h"
 #include "garaux.h"
+#include <pthread.h>
 #include <string.h>
+#include <unistd.h>
 
 
 //-----------------------------------------------------------------------------
@@ -13,17 +15,42 @@
 typedef unsigned char ginflate_byte_t; // 8bit
 typedef unsigned int ginflate_uint_t; // fast uint of 32bit or more
 typedef unsigned short ginflate_word_t; // small uint of 16bit or more
+typedef unsigned long long ginflate_bits_t; // bit accumulator of 64bit
 
 
+/**
+ * @brief Huffman dictionary.
+ *
+ * The dictionary is a two-level lookup table: the primary table is indexed
+ * by the first (root_bits) bits of a code, and its entries for the longer
+ * codes point to the subtables indexed by the following bits.
+ */
 typedef struct ginflate_hdic {
   ginflate_byte_t max_codelen;
-  ginflate_word_t lookup[32768];
+  ginflate_byte_t root_bits; // number of bits to index the primary table.
+  ginflate_byte_t root_limit; // the maximum value of root_bits.
+  ginflate_uint_t capacity; // number of entries of lookup[].
+  ginflate_uint_t *lookup;
 } ginflate_hdic_t;
 
 
+// Each table size is enough for the primary table and any set of the
+// subtables, since a subtable of (2**k) entries has (k+1) codes at least.
+#define lit_root_bits 10
+#define lit_table_size (1024 + 288/6*32) // literal/length codes.
+#define dist_root_bits 8
+#define dist_table_size (256 + 32/8*128) // distance/code length codes.
+
+
+#define window_size 32768 // the longest match distance.
+#define default_input_size 32768 // bytes of the source read at once.
+
+
 typedef struct ginflate_tag {
   ginflate_uint_t ringbuf_pos; // next write position in ringbuf.
-  ginflate_uint_t bits_acc; // accumulator of input bits.
+  ginflate_uint_t ringbuf_len; // number of valid bytes in ringbuf.
+  ginflate_byte_t *output; // beginning of the output buffer of this call.
+  ginflate_bits_t bits_acc; // accumulator of input bits.
   ginflate_uint_t bits_len; // number of accumulated bits in bits_acc.
   const ginflate_byte_t *input_p; // pointer of input buffer.
   const ginflate_byte_t *input_pend; // end of input buffer.
@@ -31,17 +58,62 @@ typedef struct ginflate_tag {
   ginflate_uint_t match_dist; // match distance.
   ginflate_byte_t bfinal; // the BFINAL flag value of the current block.
   ginflate_byte_t err; // last error.
-  ginflate_byte_t ringbuf[64*1024];
-  ginflate_byte_t inputbuf[1024];
+  ginflate_byte_t viewable; // whether the source stream can be viewed.
+  ginflate_byte_t ringbuf[window_size]; // bytes output before this call.
+  ginflate_byte_t *inputbuf; // allocated on the first read, and kept pooled.
+  size_t inputbuf_cap; // number of the allocated bytes of inputbuf.
+  size_t input_size; // number of the bytes read at once onto inputbuf.
   ginflate_hdic_t hdic_lit[1];
   ginflate_hdic_t hdic_dist[1];
+  ginflate_uint_t lit_table[lit_table_size];
+  ginflate_uint_t dist_table[dist_table_size];
   ginflate_byte_t *
     (*infl)(struct ginflate_tag *, ginflate_byte_t *, ginflate_byte_t *);
   jmp_buf env;
   gar_gfile_t gf;
+  gar_off_t in_total; // number of the bytes taken from the source stream.
+  gar_off_t out_total; // number of the bytes output before this call.
+  const gar_zindex_t *index; // access points to seek, or NULL.
+  gar_zindex_t *build; // access points being recorded, or NULL.
+  gar_ipool_t *pool; // pool to return this instance to, or NULL.
+  struct ginflate_tag *next; // next instance in the pool.
 } ginflate_t;
 
 
+/// Access point, where the decompression can be resumed.
+typedef struct zpoint {
+  gar_off_t out; // offset in the decompressed data.
+  gar_off_t bit; // offset in the compressed data, in bits.
+  ginflate_uint_t wlen; // number of the bytes of window.
+  ginflate_byte_t *window; // bytes output before the point.
+} zpoint_t;
+
+
+/// Access points of a compressed stream, made at the block boundaries.
+struct gar_zindex {
+  gar_off_t span; // the minimum distance of the points.
+  size_t num_points;
+  size_t points_cap;
+  zpoint_t *points; // in the ascending order of the offset.
+};
+
+
+#define pool_capacity 8 // the maximum number of the instances in a pool.
+
+
+/// Pool of the warm instances of ginflate_t, shared by an archive and the
+/// streams opened from it.
+struct gar_ipool {
+  const gar_allocator_t *alloc; // allocator of the instances.
+  pthread_mutex_t lock;
+  size_t refcnt; // the archive and the instances taken from the pool.
+  ginflate_t *head; // the pooled instances.
+  size_t count; // number of the pooled instances.
+  unsigned long hits;
+  unsigned long misses;
+};
+
+
 //-----------------------------------------------------------------------------
 // Error Messages
 
@@ -49,8 +121,11 @@ static const char c_prefix[] = "(inflate)";
 static const char c_err_eof[] = "unexpected EOF";
 static const char c_err_corrupt[] = "corrupted input data";
 static const char c_err_unknown[] = "corrupted inflating buffer";
-static const char c_err_seek[] = "the stream is not seekable";
+static const char c_err_size[] = "the stream size is unknown";
 static const char c_err_dup[] = "the stream cannot be duplicated";
+static const char c_err_range[] = "out-of-range seek offset";
+static const char c_err_index[] = "broken access point index";
+static const char c_err_long[] = "the output is longer than expected";
 
 
 //-----------------------------------------------------------------------------
@@ -58,6 +133,16 @@ static const char c_err_dup[] = "the stream cannot be duplicated";
 
 #define codelen_bits 4
 #define codelen_limit 16
+#define subtable_flag 16
+
+// The fast decoding loop runs while the input buffer has enough bytes to
+// refill the accumulator by a single load, and the output buffer has enough
+// room for the longest match.
+#define fast_input_min 8
+#define fast_output_min (258 + copy_overrun)
+
+// The wide copy of a match can write this number of bytes past the match.
+#define copy_overrun 16
 
 
 static const ginflate_byte_t c_clen_order[] = {
@@ -98,6 +183,7 @@ static const extra_def_t c_clenext[] = {
 static declare_inflate_fn(inflate_block);
 static declare_inflate_fn(inflate_stored);
 static declare_inflate_fn(inflate_compressed);
+static declare_inflate_fn(inflate_end);
 static declare_inflate_fn(inflate_error);
 
 
@@ -144,8 +230,36 @@ static void error(ginflate_t *I, const char *msg) {
 static const ginflate_byte_t *fetch_bytes(ginflate_t *I) {
   size_t n;
 
-  n = gar_gfile_read(&I->gf, I->inputbuf, sizeof(I->inputbuf), I->env);
+  // Decompress the source bytes in place if the source stream can be viewed.
+  if (I->viewable) {
+    const ginflate_byte_t *p;
+
+    n = (size_t)-1;
+    p = gar_gfile_view(&I->gf, &n, I->env);
+    if (p != NULL) {
+      if (n == 0) return NULL; // there is no more byte to decompress.
+      I->in_total += n;
+
+      I->input_p = p;
+      I->input_pend = &p[n];
+      return p;
+    }
+    I->viewable = 0; // copy the source bytes onto inputbuf from now on.
+  }
+
+  if (I->inputbuf_cap < I->input_size) {
+    _gar_free(I->inputbuf);
+    I->inputbuf = NULL;
+    I->inputbuf_cap = 0;
+    I->inputbuf = (I->pool != NULL) ?
+      _gar_malloc_by(I->pool->alloc, I->input_size, I->env) :
+      _gar_malloc(I->input_size, I->env);
+    I->inputbuf_cap = I->input_size;
+  }
+
+  n = gar_gfile_read(&I->gf, I->inputbuf, I->input_size, I->env);
   if (n == 0) return NULL; // there is no more byte to decompress.
+  I->in_total += n;
 
   I->input_p = I->inputbuf;
   I->input_pend = &I->inputbuf[n];
@@ -159,6 +273,23 @@ static ginflate_uint_t bitmask(ginflate_uint_t n) {
 }
 
 
+/// Load 8 bytes as an unsigned integer of 64bits in little endian.
+static ginflate_bits_t load_u64_le(const ginflate_byte_t *p) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  ginflate_bits_t x;
+  memcpy(&x, p, sizeof(x)); // compiled into a single unaligned load.
+  return x;
+#else
+  ginflate_uint_t i;
+  ginflate_bits_t x = 0;
+  for (i = 0; i < 8; i++) {
+    x |= (ginflate_bits_t)p[i] << (i * BYTE_BIT);
+  }
+  return x;
+#endif
+}
+
+
 /**
  * @brief Fetch the specified number of bits and get its value.
  *
@@ -177,7 +308,7 @@ static ginflate_uint_t fetch_bits(ginflate_t *I, ginflate_uint_t n) {
       if (p == NULL) break; // there is no more input data.
     }
 
-    I->bits_acc += (ginflate_uint_t)*p++ << I->bits_len;
+    I->bits_acc |= (ginflate_bits_t)*p++ << I->bits_len;
     I->bits_len += BYTE_BIT;
     I->input_p = p;
   }
@@ -222,7 +353,8 @@ static ginflate_uint_t get_bits(ginflate_t *I, ginflate_uint_t n) {
   }
   else {
     const ginflate_byte_t *p;
-    ginflate_uint_t bs, bl;
+    ginflate_bits_t bs;
+    ginflate_uint_t bl;
 
     p = I->input_p;
     bs = I->bits_acc;
@@ -234,7 +366,7 @@ static ginflate_uint_t get_bits(ginflate_t *I, ginflate_uint_t n) {
         if (p == NULL) error(I, c_err_eof); // insufficient input data.
       }
 
-      bs += (ginflate_uint_t)*p++ << bl;
+      bs |= (ginflate_bits_t)*p++ << bl;
       bl += BYTE_BIT;
     }
     while (bl < n);
@@ -251,25 +383,38 @@ static ginflate_uint_t get_bits(ginflate_t *I, ginflate_uint_t n) {
 //-----------------------------------------------------------------------------
 // Decoding Huffman/Extra Codes
 
-/// Pack symbol and bit length values into a single word.
-static ginflate_word_t pack_symb_and_bl(ginflate_uint_t symb,
+/// Pack symbol and bit length values into a table entry.
+/// The entries of the unassigned codes are zero (the bit length is zero).
+static ginflate_uint_t pack_symb_and_bl(ginflate_uint_t symb,
                                         ginflate_uint_t bl) {
-  return (ginflate_word_t)((symb << codelen_bits) + bl);
+  return (symb << 8) + bl;
 }
 
 
-/// Get the symbol value from a word packed by pack_symb_and_bl().
+/// Pack the offset and the index bits of a subtable into a table entry.
+static ginflate_uint_t pack_subtable(ginflate_uint_t off, ginflate_uint_t bits) {
+  return (off << 8) + subtable_flag + bits;
+}
+
+
+/// Get the symbol value (or the subtable offset) from a table entry.
 static ginflate_uint_t unpack_symb(ginflate_uint_t packed) {
-  return packed >> codelen_bits;
+  return packed >> 8;
 }
 
 
-/// Get the bit length value from a word packed by pack_symb_and_bl().
+/// Get the bit length value (or the subtable index bits) from a table entry.
 static ginflate_uint_t unpack_bl(ginflate_uint_t packed) {
   return packed & bitmask(codelen_bits);
 }
 
 
+/// Check whether a table entry points to a subtable.
+static int is_subtable(ginflate_uint_t packed) {
+  return (packed & subtable_flag) != 0;
+}
+
+
 /// Reverse the bit pattern.
 static ginflate_uint_t reverse_bits(ginflate_uint_t c, ginflate_uint_t n) {
   ginflate_uint_t i;
@@ -282,22 +427,49 @@ static ginflate_uint_t reverse_bits(ginflate_uint_t c, ginflate_uint_t n) {
 }
 
 
-/// Initialize a Huffman dictionary from the code lengths.
-static void init_huffdic(const ginflate_byte_t codelens[],
+/// Initialize a Huffman dictionary with the table and its size.
+static void setup_huffdic(ginflate_hdic_t *hdic, ginflate_uint_t *lookup,
+                          ginflate_uint_t capacity, ginflate_uint_t root_limit){
+  hdic->max_codelen = 0;
+  hdic->root_bits = 0;
+  hdic->root_limit = root_limit;
+  hdic->capacity = capacity;
+  hdic->lookup = lookup;
+  lookup[0] = 0; // no code is assigned.
+}
+
+
+/// Build a Huffman dictionary from the code lengths.
+static void init_huffdic(ginflate_t *I, const ginflate_byte_t codelens[],
                          ginflate_uint_t num_codes,
                          ginflate_hdic_t *hdic) {
-  ginflate_uint_t i;
+  ginflate_uint_t i, j;
   ginflate_uint_t code;
+  ginflate_uint_t left;
   ginflate_uint_t bl_count[codelen_limit] = { 0 };
   ginflate_uint_t next_code[codelen_limit];
+  ginflate_uint_t codes[288];
+  ginflate_word_t sorted[288];
+  ginflate_uint_t num_sorted;
   ginflate_uint_t max_codelen;
-  ginflate_uint_t hdic_size;
+  ginflate_uint_t root;
+  ginflate_uint_t used;
+  unsigned long long t = GAR_STAT_START();
 
   // Count the number of code for each code length.
   for (i = 0; i < num_codes; i++) {
     bl_count[codelens[i]]++;
   }
 
+  // Reject the over-subscribed codes; the incomplete codes are accepted,
+  // whose unassigned entries are left zero.
+  left = 1;
+  for (i = 1; i < codelen_limit; i++) {
+    left <<= 1;
+    if (bl_count[i] > left) error(I, c_err_corrupt);
+    left -= bl_count[i];
+  }
+
   // Find the numerical value of the smallest code for each code length.
   code = 0;
   bl_count[0] = 0;
@@ -306,38 +478,103 @@ static void init_huffdic(const ginflate_byte_t codelens[],
     next_code[i] = code;
   }
 
-  // Get the maximum code lengths and the optimal dictionary size.
-  // Only the slice of hdic[0..hdic_size] is used because filling all the
-  // hdic[] array with valid values costed *very* much, in experience.
+  // Get the maximum code lengths and the primary table size.
+  // Only the primary table of (2**root) entries and the used subtables are
+  // filled, since filling large tables costs much for the small blocks.
   max_codelen = 0;
-  for (i = 1; i <= 15; i++) {
+  for (i = 1; i < codelen_limit; i++) {
     if (bl_count[i]) max_codelen = i;
   }
+  root = umin(max_codelen, hdic->root_limit);
   hdic->max_codelen = max_codelen;
-  hdic_size = (1 << max_codelen);
-  memset(hdic->lookup, 0, sizeof(ginflate_word_t) * hdic_size);
+  hdic->root_bits = root;
+  memset(hdic->lookup, 0, sizeof(ginflate_uint_t) << root);
+
+  // Sort the longer codes than root in the canonical order (by the lengths
+  // and then by the symbols) to find out the codes sharing the subtables.
+  num_sorted = 0;
+  for (i = root + 1; i <= max_codelen; i++) {
+    ginflate_uint_t n = bl_count[i];
+    bl_count[i] = num_sorted; // beginning of the sorted codes of length i.
+    num_sorted += n;
+  }
 
-  // Assign the obtained codes to the lookup table.
+  // Assign the obtained codes to the primary table.
   for (i = 0; i < num_codes; i++) {
     ginflate_uint_t bl = codelens[i];
 
     if (bl > 0) { // the code is used?
       ginflate_uint_t c = next_code[bl]++;
-      ginflate_uint_t w = pack_symb_and_bl(i, bl);
-      ginflate_uint_t cstep = (1 << bl);
-      c = reverse_bits(c, bl);
-      for (; c < hdic_size; c += cstep) {
-        hdic->lookup[c] = w;
+      codes[i] = c;
+      if (bl <= root) {
+        ginflate_uint_t w = pack_symb_and_bl(i, bl);
+        ginflate_uint_t cstep = (1 << bl);
+        c = reverse_bits(c, bl);
+        for (; c < (1U << root); c += cstep) {
+          hdic->lookup[c] = w;
+        }
+      } else {
+        sorted[bl_count[bl]++] = i;
+      }
+    }
+  }
+
+  // Assign the longer codes to the subtables; the codes sharing the first
+  // (root) bits are adjacent in the canonical order, and the last one of
+  // them is the longest.
+  used = 1 << root;
+  for (i = 0; i < num_sorted; i = j) {
+    ginflate_uint_t bl = codelens[sorted[i]];
+    ginflate_uint_t prefix = codes[sorted[i]] >> (bl - root);
+    ginflate_uint_t bits;
+
+    for (j = i + 1; j < num_sorted; j++) {
+      ginflate_uint_t bl_j = codelens[sorted[j]];
+      if (codes[sorted[j]] >> (bl_j - root) != prefix) break;
+    }
+    bits = codelens[sorted[j-1]] - root;
+
+    // Allocate a new subtable.
+    if (used + (1 << bits) > hdic->capacity) error(I, c_err_corrupt);
+    memset(&hdic->lookup[used], 0, sizeof(ginflate_uint_t) << bits);
+    hdic->lookup[reverse_bits(prefix, root)] = pack_subtable(used, bits);
+
+    for (; i < j; i++) {
+      ginflate_uint_t symb = sorted[i];
+      ginflate_uint_t bl_i = codelens[symb];
+      ginflate_uint_t w = pack_symb_and_bl(symb, bl_i);
+      ginflate_uint_t cstep = 1 << (bl_i - root);
+      ginflate_uint_t c = reverse_bits(codes[symb], bl_i) >> root;
+      for (; c < (1U << bits); c += cstep) {
+        hdic->lookup[used + c] = w;
       }
     }
+
+    used += 1 << bits;
+  }
+
+  GAR_STAT_ADD(tables, 1);
+  GAR_STAT_STOP(GAR_STAGE_TABLE, t);
+}
+
+
+/// Look up the table entry of the code at the beginning of the given bits.
+static ginflate_uint_t lookup_huff(const ginflate_hdic_t *hdic,
+                                   ginflate_bits_t bits) {
+  ginflate_uint_t w = hdic->lookup[bits & bitmask(hdic->root_bits)];
+  if (is_subtable(w)) {
+    bits >>= hdic->root_bits;
+    w = hdic->lookup[unpack_symb(w) + (bits & bitmask(unpack_bl(w)))];
   }
+  return w;
 }
 
 
 /// Decode a Huffman code.
 static ginflate_uint_t decode_huff(ginflate_t *I, const ginflate_hdic_t *hdic){
   ginflate_uint_t w;
-  w = hdic->lookup[fetch_bits(I, hdic->max_codelen)];
+  w = lookup_huff(hdic, fetch_bits(I, hdic->max_codelen));
+  if (unpack_bl(w) == 0) error(I, c_err_corrupt); // unassigned code.
   drop_bits(I, unpack_bl(w));
   return unpack_symb(w);
 }
@@ -366,6 +603,7 @@ static void setup_stored(ginflate_t *I) {
 
   // Set the remaining number of bytes in this block.
   I->match_len = len;
+  GAR_STAT_ADD(blocks[0], 1);
 
   // Start to decode stored (non-compressed) block.
   I->infl = &inflate_stored;
@@ -383,12 +621,13 @@ static void setup_fixed_huffman(ginflate_t *I) {
   while (i <= 255) clbuf[i++] = 9;
   while (i <= 279) clbuf[i++] = 7;
   while (i <= 287) clbuf[i++] = 8;
-  init_huffdic(clbuf, i, I->hdic_lit);
+  init_huffdic(I, clbuf, i, I->hdic_lit);
 
   // Get the Huffman dict. for distances.
   i = 0;
   while (i <= 31) clbuf[i++] = 5;
-  init_huffdic(clbuf, i, I->hdic_dist);
+  init_huffdic(I, clbuf, i, I->hdic_dist);
+  GAR_STAT_ADD(blocks[1], 1);
 
   // Start to decode compressed block.
   I->infl = &inflate_compressed;
@@ -407,6 +646,7 @@ static void decode_clen(ginflate_t *I, const ginflate_hdic_t *hdic_clen,
       ginflate_uint_t j;
       ginflate_byte_t c = (i > 0 && l == 16) ? clbuf[i-1] : 0;
       ginflate_uint_t n = decode_ext(I, c_clenext, l-16);
+      if (n > num_codes - i) error(I, c_err_corrupt); // too many lengths.
       for (j = 0; j < n; j++) {
         clbuf[i+j] = c;
       }
@@ -433,15 +673,16 @@ static void setup_dynamic_huffman(ginflate_t *I) {
   for (i = 0; i < hclen+4; i++) {
     clbuf[c_clen_order[i]] = get_bits(I, 3);
   }
-  init_huffdic(clbuf, 19, hdic_clen);
+  init_huffdic(I, clbuf, 19, hdic_clen);
 
   // Get the Huffman dict. for literals/lengths.
   decode_clen(I, hdic_clen, clbuf, hlit+257);
-  init_huffdic(clbuf, hlit+257, I->hdic_lit);
+  init_huffdic(I, clbuf, hlit+257, I->hdic_lit);
 
   // Get the Huffman dict. for distances.
   decode_clen(I, hdic_clen, clbuf, hdist+1);
-  init_huffdic(clbuf, hdist+1, I->hdic_dist);
+  init_huffdic(I, clbuf, hdist+1, I->hdic_dist);
+  GAR_STAT_ADD(blocks[2], 1);
 
   // Start to decode compressed block.
   I->infl = &inflate_compressed;
@@ -468,7 +709,12 @@ static declare_inflate_fn(inflate_block) {
   ginflate_uint_t bfinal;
   ginflate_uint_t btype;
 
-  if (I->bfinal) return p; // there is no more block to inflate.
+  ((void)pend);
+
+  if (I->bfinal) { // there is no more block to inflate.
+    I->infl = &inflate_end;
+    return p;
+  }
 
   bfinal = get_bits(I, 1);
   btype = get_bits(I, 2);
@@ -476,38 +722,134 @@ static declare_inflate_fn(inflate_block) {
   I->bfinal = bfinal;
   c_setup_fn[btype](I);
 
-  return I->infl(I, p, pend);
+  return p;
 }
 
 
 //-----------------------------------------------------------------------------
 // Decompression
 
-/// Put a new byte to the ring buffer.
-static ginflate_byte_t ringbuf_put(ginflate_t *I, ginflate_byte_t c) {
-  I->ringbuf[I->ringbuf_pos] = c;
-  I->ringbuf_pos = (I->ringbuf_pos + 1) % sizeof(I->ringbuf);
-  return c;
+/**
+ * @brief Put the bytes output by this call to the ring buffer.
+ *
+ * The bytes output by the current call are used as the history of the
+ * matches in place, and only the last bytes of them are copied to the ring
+ * buffer at the end of the call.
+ */
+static void ringbuf_update(ginflate_t *I, const ginflate_byte_t *p) {
+  size_t n = p - I->output;
+  ginflate_uint_t pos = I->ringbuf_pos;
+  ginflate_uint_t m;
+
+  if (n >= window_size) {
+    memcpy(I->ringbuf, p - window_size, window_size);
+    I->ringbuf_pos = 0;
+    I->ringbuf_len = window_size;
+    return;
+  }
+
+  // Copy the bytes with wraparound.
+  m = umin((ginflate_uint_t)n, window_size - pos);
+  memcpy(&I->ringbuf[pos], I->output, m);
+  memcpy(I->ringbuf, &I->output[m], n - m);
+  I->ringbuf_pos = (pos + n) % window_size;
+  I->ringbuf_len = umin(I->ringbuf_len + (ginflate_uint_t)n, window_size);
 }
 
 
 /// Decompress a non-compressed block.
 static declare_inflate_fn(inflate_stored) {
-  ginflate_uint_t i;
   ginflate_uint_t n = umin(I->match_len, pend-p);
-  for (i = 0; i < n; i++) {
-    p[i] = ringbuf_put(I, get_bits(I, 8));
-  }
+  ginflate_uint_t m;
+
   I->match_len -= n;
-  p += n;
+
+  // Drain the whole bytes in the accumulator; the block data begins at a
+  // byte boundary.
+  while (n > 0 && I->bits_len >= BYTE_BIT) {
+    *p++ = (ginflate_byte_t)I->bits_acc;
+    I->bits_acc >>= BYTE_BIT;
+    I->bits_len -= BYTE_BIT;
+    n--;
+  }
+
+  while (n > 0) {
+    // Copy the bytes in the input buffer.
+    m = umin(n, I->input_pend - I->input_p);
+    memcpy(p, I->input_p, m);
+    I->input_p += m;
+    p += m;
+    n -= m;
+    if (n == 0) break;
+
+    // Read the large rest of the block straight from the source stream.
+    if (!I->viewable && n >= I->input_size) {
+      m = gar_gfile_read(&I->gf, p, n, I->env);
+      I->in_total += m;
+      if (m < n) error(I, c_err_eof); // insufficient input data.
+      p += m;
+      break;
+    }
+
+    if (fetch_bytes(I) == NULL) error(I, c_err_eof); // insufficient input.
+  }
+
   if (I->match_len == 0) { // reached the end of block.
     I->infl = &inflate_block;
-    return inflate_block(I, p, pend);
   }
   return p;
 }
 
 
+/**
+ * @brief Copy a match of the given distance by words.
+ *
+ * The overlapping matches of the short distances are copied by replicating
+ * the pattern of the period in a word. This function can write at most
+ * copy_overrun bytes past the match.
+ */
+static void copy_match_wide(ginflate_byte_t *p, ginflate_uint_t dist,
+                            ginflate_uint_t n) {
+  const ginflate_byte_t *q = p - dist;
+  ginflate_byte_t *pend = p + n;
+
+  if (dist >= 16) {
+    do {
+      memcpy(p, q, 16); // compiled into a pair of 16-byte load and store.
+      p += 16;
+      q += 16;
+    }
+    while (p < pend);
+  }
+  else if (dist >= 8) {
+    do {
+      memcpy(p, q, 8);
+      p += 8;
+      q += 8;
+    }
+    while (p < pend);
+  }
+  else if (dist == 1) {
+    memset(p, *q, n);
+  }
+  else {
+    ginflate_byte_t pattern[8];
+    ginflate_uint_t period = 8 - 8 % dist; // multiple of dist.
+    ginflate_uint_t i;
+
+    // Broadcast the pattern onto a word, and put the word at every period.
+    for (i = 0; i < 8; i++) {
+      pattern[i] = q[i % dist];
+    }
+    do {
+      memcpy(p, pattern, 8);
+      p += period;
+    }
+    while (p < pend);
+  }
+}
+
+
 /// Expand a match (of Lampel-Ziv) in compressed block.
 static ginflate_byte_t *expand_match(ginflate_t *I,
                                      ginflate_byte_t *p,
@@ -515,17 +857,126 @@ static ginflate_byte_t *expand_match(ginflate_t *I,
   ginflate_uint_t i;
   ginflate_uint_t n = umin(I->match_len, pend-p);
   ginflate_uint_t dist = I->match_dist;
-  ginflate_uint_t pos = I->ringbuf_pos;
-  ginflate_byte_t *ringbuf = I->ringbuf;
-  for (i = 0; i < n; i++) {
-    ginflate_byte_t c = ringbuf[(pos - dist) % sizeof(I->ringbuf)];
-    ringbuf[pos] = c;
-    *p++ = c;
-    pos = (pos + 1) % sizeof(I->ringbuf);
-  }
+  size_t nout = p - I->output;
+  const ginflate_byte_t *q;
+
   I->match_len -= n;
-  I->ringbuf_pos = pos;
+
+  // Copy the bytes from the ring buffer if the match begins before the
+  // output buffer of this call; the wraparound is split at most once.
+  if (dist > nout) {
+    ginflate_uint_t k = dist - nout; // number of the bytes in ringbuf.
+    ginflate_uint_t pos, m;
+    if (k > I->ringbuf_len) error(I, c_err_corrupt); // too far distance.
+    pos = (I->ringbuf_pos - k) % window_size;
+    k = umin(k, n);
+    m = umin(k, window_size - pos);
+    memcpy(p, &I->ringbuf[pos], m);
+    memcpy(&p[m], I->ringbuf, k - m);
+    p += k;
+    n -= k;
+  }
+
+  // Copy the rest of the bytes from the output buffer.
+  if (n == 0) {
+    return p;
+  }
+  else if ((size_t)(pend - p) >= n + copy_overrun) {
+    copy_match_wide(p, dist, n);
+  }
+  else if (dist >= n) { // not overlapping.
+    memcpy(p, p - dist, n);
+  }
+  else {
+    q = p - dist;
+    for (i = 0; i < n; i++) {
+      p[i] = q[i];
+    }
+  }
+
+  return p + n;
+}
+
+
+/**
+ * @brief Decompress a compressed block while the buffers have enough room.
+ *
+ * The accumulator is refilled to 56 bits or more by a single 8-byte load per
+ * symbol, which is enough for the longest sequence of a length code, its
+ * extra bits, a distance code and its extra bits (48 bits); so none of the
+ * input and output bounds are checked for each code.
+ */
+static declare_inflate_fn(inflate_fast) {
+  const ginflate_byte_t *in = I->input_p;
+  const ginflate_byte_t *inend = I->input_pend;
+  ginflate_bits_t acc = I->bits_acc;
+  ginflate_uint_t len = I->bits_len;
+  const ginflate_hdic_t *hdic_lit = I->hdic_lit;
+  const ginflate_hdic_t *hdic_dist = I->hdic_dist;
+  size_t num_literals = 0; // counted in the registers, and flushed once.
+  size_t num_matches = 0;
+
+  while (pend - p >= fast_output_min && inend - in >= fast_input_min) {
+    ginflate_uint_t w, l, c;
+
+    // Refill the accumulator; the bits above (len) are either zero or the
+    // same bits as those which are loaded again.
+    acc |= load_u64_le(in) << len;
+    in += (63 - len) / BYTE_BIT;
+    len |= 56;
+
+    // Decode a literal/length code.
+    w = lookup_huff(hdic_lit, acc);
+    if (unpack_bl(w) == 0) goto corrupt; // unassigned code.
+    acc >>= unpack_bl(w);
+    len -= unpack_bl(w);
+    l = unpack_symb(w);
+
+    if (l < 256) {
+      *p++ = (ginflate_byte_t)l;
+      num_literals++;
+      continue;
+    }
+    if (l == 256) { // end of block.
+      I->infl = &inflate_block;
+      break;
+    }
+    if (l - 257 >= sizeof(c_lenext) / sizeof(c_lenext[0])) goto corrupt;
+
+    // Decode the match length.
+    c = l - 257;
+    I->match_len = c_lenext[c].base + (ginflate_uint_t)(acc &
+                                         bitmask(c_lenext[c].bits));
+    acc >>= c_lenext[c].bits;
+    len -= c_lenext[c].bits;
+
+    // Decode the match distance.
+    w = lookup_huff(hdic_dist, acc);
+    if (unpack_bl(w) == 0) goto corrupt; // unassigned code.
+    acc >>= unpack_bl(w);
+    len -= unpack_bl(w);
+    c = unpack_symb(w);
+    if (c >= sizeof(c_distext) / sizeof(c_distext[0])) goto corrupt;
+    I->match_dist = c_distext[c].base + (ginflate_uint_t)(acc &
+                                          bitmask(c_distext[c].bits));
+    acc >>= c_distext[c].bits;
+    len -= c_distext[c].bits;
+
+    p = expand_match(I, p, pend);
+    num_matches++;
+  }
+
+  GAR_STAT_ADD(literals, num_literals);
+  GAR_STAT_ADD(matches, num_matches);
+
+  // Drop the bits above (len) for the careful decoding functions.
+  I->input_p = in;
+  I->bits_acc = acc & (((ginflate_bits_t)1 << len) - 1);
+  I->bits_len = len;
   return p;
+
+corrupt:
+  error(I, c_err_corrupt);
 }
 
 
@@ -536,18 +987,37 @@ static declare_inflate_fn(inflate_compressed) {
   }
 
   while (p < pend) {
-    ginflate_uint_t l = decode_huff(I, I->hdic_lit);
+    ginflate_uint_t l;
+
+    if (pend - p >= fast_output_min &&
+        I->input_pend - I->input_p >= fast_input_min) {
+      p = inflate_fast(I, p, pend);
+      if (I->infl != &inflate_compressed) break; // end of block.
+      continue;
+    }
+
+    l = decode_huff(I, I->hdic_lit);
     if (l < 256) {
-      *p++ = ringbuf_put(I, (ginflate_byte_t)l);
+      *p++ = (ginflate_byte_t)l;
+      GAR_STAT_ADD(literals, 1);
     }
     else if (l >= 257) {
+      ginflate_uint_t d;
+      if (l - 257 >= sizeof(c_lenext) / sizeof(c_lenext[0])) {
+        error(I, c_err_corrupt);
+      }
       I->match_len = decode_ext(I, c_lenext, l-257);
-      I->match_dist = decode_ext(I, c_distext, decode_huff(I, I->hdic_dist));
+      d = decode_huff(I, I->hdic_dist);
+      if (d >= sizeof(c_distext) / sizeof(c_distext[0])) {
+        error(I, c_err_corrupt);
+      }
+      I->match_dist = decode_ext(I, c_distext, d);
       p = expand_match(I, p, pend);
+      GAR_STAT_ADD(matches, 1);
     }
     else { // end of block.
       I->infl = &inflate_block;
-      return inflate_block(I, p, pend);
+      break;
     }
   }
 
@@ -555,6 +1025,14 @@ static declare_inflate_fn(inflate_compressed) {
 }
 
 
+/// Decompress nothing after the final block.
+static declare_inflate_fn(inflate_end) {
+  ((void)I);
+  ((void)pend);
+  return p;
+}
+
+
 /**
  * @brief Raise decompression error.
  *
@@ -568,11 +1046,203 @@ static declare_inflate_fn(inflate_error) {
 }
 
 
+/**
+ * @brief Copy the history before @a p (at most window_size bytes).
+ * @return number of the copied bytes.
+ */
+static ginflate_uint_t copy_history(const ginflate_t *I,
+                                    const ginflate_byte_t *p,
+                                    ginflate_byte_t *dst) {
+  size_t nout = p - I->output;
+  ginflate_uint_t n = (nout >= window_size) ? window_size :
+                      umin(I->ringbuf_len + (ginflate_uint_t)nout, window_size);
+  ginflate_uint_t k, pos, m;
+
+  if (nout >= n) {
+    memcpy(dst, p - n, n);
+    return n;
+  }
+
+  // Copy the older bytes from the ring buffer with wraparound.
+  k = n - (ginflate_uint_t)nout;
+  pos = (I->ringbuf_pos - k) % window_size;
+  m = umin(k, window_size - pos);
+  memcpy(dst, &I->ringbuf[pos], m);
+  memcpy(&dst[m], I->ringbuf, k - m);
+  memcpy(&dst[k], I->output, nout);
+  return n;
+}
+
+
+/// Get the offset in bits of the next bit to be decoded.
+static gar_off_t bit_offset(const ginflate_t *I) {
+  return I->in_total * BYTE_BIT -
+         (gar_off_t)(I->input_pend - I->input_p) * BYTE_BIT - I->bits_len;
+}
+
+
+/**
+ * @brief Record an access point at the block boundary before @a p.
+ *
+ * The point is recorded if it is the span or more apart from the last one,
+ * and if any block follows.
+ */
+static void add_point(ginflate_t *I, const ginflate_byte_t *p) {
+  gar_zindex_t *X = I->build;
+  gar_off_t out = I->out_total + (p - I->output);
+  gar_off_t last = (X->num_points > 0) ? X->points[X->num_points-1].out : 0;
+  zpoint_t *pt;
+
+  if (I->bfinal || out - last < X->span) return;
+
+  // Extend the point array if it is full.
+  if (X->num_points == X->points_cap) {
+    size_t cap = (X->points_cap > 0) ? X->points_cap * 2 : 16;
+    X->points = _gar_realloc(X->points, sizeof(zpoint_t) * cap, I->env);
+    X->points_cap = cap;
+  }
+
+  // The point is the bit just after the consumed ones.
+  pt = &X->points[X->num_points];
+  pt->out = out;
+  pt->bit = bit_offset(I);
+  pt->window = _gar_malloc(window_size, I->env);
+  pt->wlen = copy_history(I, p, pt->window);
+  X->num_points++;
+}
+
+
+//-----------------------------------------------------------------------------
+// Instance Pool
+
+/// Create a new pool, referred by the caller.
+/// The pooled instances are allocated by @a A.
+gar_ipool_t *_gar_ipool_new(const gar_allocator_t *A, jmp_buf env) {
+  gar_ipool_t *P = _gar_malloc_by(A, sizeof(gar_ipool_t), env);
+  P->alloc = A;
+  pthread_mutex_init(&P->lock, NULL);
+  P->refcnt = 1;
+  P->head = NULL;
+  P->count = 0;
+  P->hits = 0;
+  P->misses = 0;
+  return P;
+}
+
+
+/// Free an instance with its input buffer.
+static void ginflate_free(ginflate_t *I) {
+  _gar_free(I->inputbuf);
+  _gar_free(I);
+}
+
+
+/// Drop a reference to the pool, and free it if it is no longer referred.
+static void ipool_unref_locked(gar_ipool_t *P) {
+  ginflate_t *I;
+
+  if (--P->refcnt > 0) {
+    pthread_mutex_unlock(&P->lock);
+    return;
+  }
+  pthread_mutex_unlock(&P->lock);
+
+  while ((I = P->head) != NULL) {
+    P->head = I->next;
+    ginflate_free(I);
+  }
+  pthread_mutex_destroy(&P->lock);
+  _gar_free(P);
+}
+
+
+/// Drop the caller's reference to the pool.
+void _gar_ipool_release(gar_ipool_t *P) {
+  if (P != NULL) {
+    pthread_mutex_lock(&P->lock);
+    ipool_unref_locked(P);
+  }
+}
+
+
+/// Get the number of the instances taken from the pool (hits) and allocated
+/// newly (misses).
+void _gar_ipool_stats(gar_ipool_t *P, unsigned long *hits,
+                      unsigned long *misses) {
+  pthread_mutex_lock(&P->lock);
+  *hits = P->hits;
+  *misses = P->misses;
+  pthread_mutex_unlock(&P->lock);
+}
+
+
+/// Take an instance from the pool, or allocate a new one if the pool is
+/// empty or NULL; the instance refers to the pool until it is released.
+static ginflate_t *ginflate_acquire(gar_ipool_t *P, jmp_buf env) {
+  ginflate_t *I = NULL;
+
+  if (P != NULL) {
+    pthread_mutex_lock(&P->lock);
+    if ((I = P->head) != NULL) {
+      P->head = I->next;
+      P->count--;
+      P->hits++;
+      P->refcnt++;
+    } else {
+      P->misses++;
+    }
+    pthread_mutex_unlock(&P->lock);
+  }
+
+  if (I == NULL) {
+    if (P != NULL) {
+      I = _gar_malloc_by(P->alloc, sizeof(ginflate_t), env);
+    } else {
+      I = _gar_malloc(sizeof(ginflate_t), env);
+    }
+    I->inputbuf = NULL;
+    I->inputbuf_cap = 0;
+    if (P != NULL) {
+      pthread_mutex_lock(&P->lock);
+      P->refcnt++;
+      pthread_mutex_unlock(&P->lock);
+    }
+  }
+  I->pool = P;
+  return I;
+}
+
+
+/// Return an instance to its pool, or free it if the pool is full or NULL.
+static void ginflate_release(ginflate_t *I) {
+  gar_ipool_t *P = I->pool;
+
+  if (P == NULL) {
+    ginflate_free(I);
+    return;
+  }
+
+  pthread_mutex_lock(&P->lock);
+  if (P->count < pool_capacity) {
+    I->next = P->head;
+    P->head = I;
+    P->count++;
+  } else {
+    ginflate_free(I);
+  }
+  ipool_unref_locked(P);
+}
+
+
 //-----------------------------------------------------------------------------
 // Meta Operations
 
+/// Reset the state to decompress a new stream; the lookup tables and the
+/// buffers are reused as they are.
 void ginflate_init(ginflate_t *I) {
   I->ringbuf_pos = 0;
+  I->ringbuf_len = 0;
+  I->output = NULL;
   I->bits_acc = 0;
   I->bits_len = 0;
   I->input_p = NULL;
@@ -581,18 +1251,117 @@ void ginflate_init(ginflate_t *I) {
   I->match_dist = 0;
   I->bfinal = 0;
   I->err = 0;
+  I->viewable = 1;
+  I->input_size = default_input_size;
+  setup_huffdic(I->hdic_lit, I->lit_table, lit_table_size, lit_root_bits);
+  setup_huffdic(I->hdic_dist, I->dist_table, dist_table_size, dist_root_bits);
   I->infl = &inflate_block;
   gar_gfile_null(&I->gf);
+  I->in_total = 0;
+  I->out_total = 0;
+  I->index = NULL;
+  I->build = NULL;
 }
 
 
 static size_t ginflate(ginflate_t *I, void *ptr, size_t n) {
   ginflate_byte_t *p = (ginflate_byte_t *)ptr;
-  ginflate_byte_t *q = (*I->infl)(I, p, p+n);
+  ginflate_byte_t *q = p;
+  ginflate_byte_t *pend = p + n;
+  unsigned long long t = GAR_STAT_START();
+  I->output = p;
+  while (q < pend && I->infl != &inflate_end) {
+    if (I->build != NULL && I->infl == &inflate_block) add_point(I, q);
+    q = (*I->infl)(I, q, pend);
+  }
+  ringbuf_update(I, q);
+  I->out_total += q - p;
+  GAR_STAT_ADD(out_bytes, q - p);
+  GAR_STAT_STOP(GAR_STAGE_INFLATE, t);
   return q - p;
 }
 
 
+//-----------------------------------------------------------------------------
+// Random Access
+
+/// Find the last access point at or before the offset, or NULL if none.
+static const zpoint_t *find_point(const gar_zindex_t *X, gar_off_t off) {
+  size_t lo = 0;
+  size_t hi = (X != NULL) ? X->num_points : 0;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (X->points[mid].out <= off) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return (lo > 0) ? &X->points[lo-1] : NULL;
+}
+
+
+/// Reset the state to decompress the source stream from the bit @a bit.
+static void reset_at(ginflate_t *I, gar_off_t bit) {
+  gar_gfile_t gf = I->gf;
+
+  ginflate_init(I);
+  I->gf = gf;
+
+  // Seek the source stream to the byte of the bit, and drop the leading bits
+  // of the byte.
+  gar_gfile_seek(&I->gf, bit / BYTE_BIT, I->env);
+  I->in_total = bit / BYTE_BIT;
+  if (bit % BYTE_BIT != 0) {
+    get_bits(I, (ginflate_uint_t)(bit % BYTE_BIT));
+  }
+}
+
+
+/// Restart the decompression from the access point (or the beginning).
+static void restart(ginflate_t *I, const zpoint_t *pt) {
+  const gar_zindex_t *X = I->index;
+  size_t input_size = I->input_size;
+
+  reset_at(I, (pt != NULL) ? pt->bit : 0);
+  I->index = X;
+  I->input_size = input_size;
+
+  // Restore the history.
+  if (pt != NULL) {
+    memcpy(I->ringbuf, pt->window, pt->wlen);
+    I->ringbuf_pos = pt->wlen % window_size;
+    I->ringbuf_len = pt->wlen;
+    I->out_total = pt->out;
+  }
+}
+
+
+/**
+ * @brief Move to the offset of the decompressed data.
+ *
+ * The decompression is resumed from the nearest access point before the
+ * offset (or the beginning), unless the offset is ahead of the current one
+ * and no nearer point exists; then the bytes up to the offset are skipped.
+ */
+static void ginflate_seek(ginflate_t *I, gar_off_t off) {
+  const zpoint_t *pt = find_point(I->index, off);
+  ginflate_byte_t s[8192];
+  size_t n;
+
+  if (off < I->out_total || (pt != NULL && pt->out > I->out_total)) {
+    restart(I, pt);
+  }
+
+  while (I->out_total < off) {
+    n = (size_t)((off - I->out_total < sizeof(s)) ? off - I->out_total :
+                                                     sizeof(s));
+    if (ginflate(I, s, n) < n) error(I, c_err_range);
+  }
+}
+
+
 //-----------------------------------------------------------------------------
 // Stream
 
@@ -603,10 +1372,24 @@ static size_t ginflate_on_read(void *ud, void *ptr, size_t n, jmp_buf env) {
 }
 
 
+static const void *ginflate_on_view(void *ud, size_t *n, jmp_buf env) {
+  ((void)ud);
+  ((void)n);
+  ((void)env);
+  return NULL; // not supported.
+}
+
+
 static void ginflate_on_seek(void *ud, gar_off_t off, jmp_buf env) {
+  ginflate_t *I = (ginflate_t *)ud;
+  if (setjmp(I->env)) { longjmp(env, 1); }
+  ginflate_seek(I, off);
+}
+
+
+static gar_off_t ginflate_on_size(void *ud, jmp_buf env) {
   ((void)ud);
-  ((void)off);
-  _gar_error(env, c_prefix, c_err_seek);
+  _gar_error(env, c_prefix, c_err_size);
 }
 
 
@@ -620,16 +1403,21 @@ static void ginflate_on_dup(void *ud, gar_gfile_t *dst, jmp_buf env) {
 static void ginflate_on_close(void *ud) {
   ginflate_t *I = (ginflate_t *)ud;
   gar_gfile_close(&I->gf);
-  _gar_free(I);
+  ginflate_release(I);
 }
 
 
-static ginflate_t *ginflate_on_open(gar_gfile_v *gf, jmp_buf env) {
+static ginflate_t *ginflate_on_open(gar_gfile_v *gf, gar_ipool_t *P,
+                                    const gar_open_opts_t *O, jmp_buf env) {
   ginflate_t *I;
 
-  // Allocate a new ginflate_t instance and initialize it.
-  I = _gar_malloc(sizeof(ginflate_t), env);
+  // Take a ginflate_t instance from the pool and initialize it.
+  I = ginflate_acquire(P, env);
   ginflate_init(I);
+  if (O != NULL) {
+    I->index = O->index;
+    if (O->bufsize > 0) I->input_size = O->bufsize;
+  }
 
   // Move the given source stream.
   I->gf = *gf;
@@ -642,16 +1430,961 @@ static ginflate_t *ginflate_on_open(gar_gfile_v *gf, jmp_buf env) {
 static const gar_gfile_t c_ginflate_fn = {
   NULL,
   &ginflate_on_read,
+  &ginflate_on_view,
   &ginflate_on_seek,
+  &ginflate_on_size,
   &ginflate_on_dup,
   &ginflate_on_close,
+  NULL, // the decompressed bytes are not read ahead.
 };
 
 
+/**
+ * @brief Open a decompressing stream of the source stream.
+ *
+ * The decompressor is taken from the pool @a P (can be NULL). The stream can
+ * be sought if the source stream can be. The options @a O (can be NULL) set
+ * the bytes read from the source at once and the access point index, which
+ * has to be alive until the stream is closed.
+ */
+void _gar_inflate(gar_gfile_v *gf, gar_ipool_t *P, const gar_open_opts_t *O,
+                  jmp_buf env) {
+  _gar_setup_gfile(gf, &c_ginflate_fn, ginflate_on_open(gf, P, O, env));
+}
+
+
 void gar_inflate(gar_gfile_v *gf, jmp_buf env) {
-  gf->ud = ginflate_on_open(gf, env);
-  gf->read = c_ginflate_fn.read;
-  gf->seek = c_ginflate_fn.seek;
-  gf->dup = c_ginflate_fn.dup;
-  gf->close = c_ginflate_fn.close;
+  _gar_inflate(gf, NULL, NULL, env);
+}
+
+
+/**
+ * @brief Get the number of the source bytes taken but not decompressed.
+ *
+ * After the decompressing stream @a gf reached the end of the deflate data,
+ * these last bytes taken from the source stream follow the deflate data.
+ */
+size_t _gar_inflate_unused(const gar_gfile_t *gf) {
+  const ginflate_t *I = (const ginflate_t *)gf->ud;
+  return (I->input_pend - I->input_p) + I->bits_len / BYTE_BIT;
+}
+
+
+//-----------------------------------------------------------------------------
+// One-shot Decompression
+
+/**
+ * @brief Decompress the whole source stream into the buffer at once.
+ *
+ * The buffer is the only history of the matches, so no byte is staged in the
+ * ring buffer. The source stream is borrowed; it is not closed.
+ * @return number of the decompressed bytes. Raises error if the decompressed
+ * data is longer than @a n bytes.
+ */
+size_t _gar_inflate_buffer(const gar_gfile_t *gf, void *ptr, size_t n,
+                           gar_ipool_t *P, jmp_buf env) {
+  ginflate_t *volatile I = NULL;
+  ginflate_byte_t *p = (ginflate_byte_t *)ptr;
+  ginflate_byte_t *q = p;
+  ginflate_byte_t *pend = p + n;
+  ginflate_byte_t extra[1];
+  unsigned long long t = GAR_STAT_START();
+
+  I = ginflate_acquire(P, env);
+  if (setjmp(I->env)) {
+    ginflate_release(I);
+    longjmp(env, 1);
+  }
+  ginflate_init(I);
+  I->gf = *gf;
+
+  I->output = p;
+  while (q < pend && I->infl != &inflate_end) {
+    q = (*I->infl)(I, q, pend);
+  }
+
+  // Make sure that no more byte follows; the rest of the stream can have
+  // only the end-of-block codes and the empty blocks.
+  I->output = extra;
+  while (I->infl != &inflate_end) {
+    if ((*I->infl)(I, extra, &extra[1]) != extra) error(I, c_err_long);
+  }
+
+  ginflate_release(I);
+  GAR_STAT_ADD(out_bytes, q - p);
+  GAR_STAT_STOP(GAR_STAGE_INFLATE, t);
+  return q - p;
+}
+
+
+size_t gar_inflate_buffer(const gar_gfile_t *gf, void *ptr, size_t n,
+                          jmp_buf env) {
+  return _gar_inflate_buffer(gf, ptr, n, NULL, env);
+}
+
+
+//-----------------------------------------------------------------------------
+// Parallel Decompression
+
+#define symbol_marker 256 // symbols of this value or more refer to a window.
+#define no_boundary ((gar_off_t)-1)
+
+
+/**
+ * @brief Chunk of the compressed data decompressed by a worker.
+ *
+ * The worker begins at the first block boundary found in the chunk, and
+ * decompresses the blocks until it reaches the boundary found in a later
+ * chunk, or the end of the data. The bytes before the boundary are unknown,
+ * so the output begins with the symbols: a byte, or a reference
+ * (symbol_marker + i) to the byte i of the unknown window of window_size
+ * bytes before the boundary. Once the last window_size symbols are all bytes,
+ * the rest is decompressed into bytes as usual.
+ */
+typedef struct pchunk {
+  gar_off_t begin; // first bit to search for a block boundary.
+  gar_off_t start; // bit of the found block boundary, or no_boundary.
+  size_t next; // chunk whose boundary is reached, or num_chunks at the end.
+  int failed; // nonzero if the decompression is failed.
+  ginflate_word_t *syms;
+  size_t num_syms;
+  size_t syms_cap;
+  size_t marked; // number of the symbols up to the last window reference.
+  ginflate_byte_t *bytes; // decompressed after the symbols.
+  size_t num_bytes;
+  size_t bytes_cap;
+} pchunk_t;
+
+
+/// Decompression shared by the worker threads.
+typedef struct pjob {
+  const ginflate_byte_t *src; // the whole compressed data.
+  size_t len;
+  size_t limit; // the maximum number of the decompressed bytes.
+  pchunk_t *chunks;
+  size_t num_chunks;
+  void (*task)(struct pjob *, size_t); // run for each chunk.
+  size_t next; // index of the next chunk to be taken (atomic).
+  gar_ipool_t *pool;
+  gar_counters_t *counters;
+  const gar_allocator_t *alloc; // allocator of the calling thread.
+} pjob_t;
+
+
+/// Get the 57 bits or more from the bit @a bit of the byte string; the bytes
+/// past the end are zeros.
+static ginflate_bits_t peek_bits(const ginflate_byte_t *s, size_t len,
+                                 gar_off_t bit) {
+  size_t i = (size_t)(bit / BYTE_BIT);
+  ginflate_bits_t x = 0;
+  ginflate_uint_t k;
+
+  if (len >= 8 && i <= len - 8) {
+    x = load_u64_le(&s[i]);
+  } else {
+    for (k = 0; k < 8 && i + k < len; k++) {
+      x |= (ginflate_bits_t)s[i + k] << (k * BYTE_BIT);
+    }
+  }
+  return x >> (bit % BYTE_BIT);
+}
+
+
+/**
+ * @brief Check quickly whether a block header can begin at the bit @a bit.
+ *
+ * A stored block has the zero padding and the complementary lengths, and a
+ * dynamic block has a complete code length code. If @a strict is nonzero,
+ * only the non-final stored and dynamic blocks are accepted; the fixed
+ * blocks are too likely to match at random.
+ */
+static int maybe_header(const ginflate_byte_t *s, size_t len, gar_off_t bit,
+                        int strict) {
+  ginflate_bits_t x = peek_bits(s, len, bit);
+  ginflate_uint_t i, n, left;
+
+  if (strict && (x & 1)) return 0; // BFINAL=1.
+  if ((x & 6) == 0) { // BTYPE=00.
+    n = (ginflate_uint_t)(BYTE_BIT - (bit + 3) % BYTE_BIT) % BYTE_BIT;
+    if ((x >> 3) & bitmask(n)) return 0;
+    x >>= 3 + n;
+    return (x & 0xffff) == (((x >> 16) & 0xffff) ^ 0xffff);
+  }
+  if ((x & 6) == 2) return !strict; // BTYPE=01.
+  if ((x & 6) != 4) return 0; // BTYPE=11.
+
+  // HLIT and HDIST of 30 or more are not used.
+  if (((x >> 3) & 31) > 29 || ((x >> 8) & 31) > 29) return 0;
+  n = (ginflate_uint_t)((x >> 13) & 15) + 4;
+
+  // The code lengths of the code length code (3 bits each) are complete.
+  x = peek_bits(s, len, bit + 17);
+  left = 1 << 7;
+  for (i = 0; i < n; i++) {
+    ginflate_uint_t l = (ginflate_uint_t)(x >> (i * 3)) & 7;
+    if (l > 0) {
+      if ((1U << (7 - l)) > left) return 0;
+      left -= 1 << (7 - l);
+    }
+  }
+  return left == 0;
+}
+
+
+/// Make room for @a n more symbols of the chunk.
+static void reserve_syms(ginflate_t *I, pchunk_t *C, size_t n, size_t limit) {
+  size_t cap;
+
+  if (C->num_syms + n <= C->syms_cap) return;
+  if (C->num_syms + n > limit + 258) error(I, c_err_long);
+  cap = (C->syms_cap > 0) ? C->syms_cap * 2 : 65536;
+  if (cap < C->num_syms + n) cap = C->num_syms + n;
+  C->syms = _gar_realloc(C->syms, sizeof(ginflate_word_t) * cap, I->env);
+  C->syms_cap = cap;
+}
+
+
+/// Decompress a stored block into the symbols until the last @a clean_max
+/// symbols are bytes.
+static void symbols_stored(ginflate_t *I, pchunk_t *C, size_t limit,
+                           size_t clean_max) {
+  while (I->match_len > 0 && C->num_syms - C->marked < clean_max) {
+    reserve_syms(I, C, 1, limit);
+    C->syms[C->num_syms++] = (ginflate_word_t)get_bits(I, BYTE_BIT);
+    I->match_len--;
+  }
+  if (I->match_len == 0) { // reached the end of block.
+    I->infl = &inflate_block;
+  }
+}
+
+
+/// Copy a match of the symbols reserved already; the symbols before the chunk
+/// refer to the window.
+static void copy_symbols(ginflate_t *I, pchunk_t *C, ginflate_uint_t len,
+                         ginflate_uint_t dist) {
+  size_t pos = C->num_syms;
+  ginflate_word_t *w = &C->syms[pos];
+  ginflate_uint_t i = 0;
+
+  if (dist > pos) {
+    if (dist - pos > window_size) error(I, c_err_corrupt); // too far distance.
+    for (; i < len && pos + i < dist; i++) {
+      w[i] = (ginflate_word_t)(symbol_marker + window_size - (dist - pos - i));
+    }
+    C->marked = pos + i;
+  } else if (dist >= len && C->marked <= pos - dist) {
+    // Neither overlapping nor copying a window reference.
+    memcpy(w, w - dist, sizeof(ginflate_word_t) * len);
+    C->num_syms += len;
+    return;
+  }
+  for (; i < len; i++) {
+    w[i] = C->syms[pos + i - dist];
+  }
+  C->num_syms += len;
+
+  // Find the last window reference copied, if any.
+  if (dist > pos || C->marked > pos - dist) {
+    for (i = len; i > 0; i--) {
+      if (w[i - 1] >= symbol_marker) {
+        C->marked = pos + i;
+        break;
+      }
+    }
+  }
+}
+
+
+/// Decompress a compressed block into the symbols while the input buffer has
+/// enough bytes, in the same way as inflate_fast().
+static void symbols_fast(ginflate_t *I, pchunk_t *C, size_t limit,
+                         size_t clean_max) {
+  const ginflate_byte_t *in = I->input_p;
+  const ginflate_byte_t *inend = I->input_pend;
+  ginflate_bits_t acc = I->bits_acc;
+  ginflate_uint_t len = I->bits_len;
+  const ginflate_hdic_t *hdic_lit = I->hdic_lit;
+  const ginflate_hdic_t *hdic_dist = I->hdic_dist;
+  size_t num_literals = 0;
+  size_t num_matches = 0;
+
+  while (inend - in >= fast_input_min && C->num_syms - C->marked < clean_max) {
+    ginflate_uint_t w, l, c, mlen, dist;
+
+    if (C->syms_cap - C->num_syms < 258) reserve_syms(I, C, 258, limit);
+
+    acc |= load_u64_le(in) << len;
+    in += (63 - len) / BYTE_BIT;
+    len |= 56;
+
+    // Decode a literal/length code.
+    w = lookup_huff(hdic_lit, acc);
+    if (unpack_bl(w) == 0) goto corrupt; // unassigned code.
+    acc >>= unpack_bl(w);
+    len -= unpack_bl(w);
+    l = unpack_symb(w);
+
+    if (l < 256) {
+      C->syms[C->num_syms++] = (ginflate_word_t)l;
+      num_literals++;
+      continue;
+    }
+    if (l == 256) { // end of block.
+      I->infl = &inflate_block;
+      break;
+    }
+    if (l - 257 >= sizeof(c_lenext) / sizeof(c_lenext[0])) goto corrupt;
+
+    // Decode the match length and distance.
+    c = l - 257;
+    mlen = c_lenext[c].base + (ginflate_uint_t)(acc &
+                                                bitmask(c_lenext[c].bits));
+    acc >>= c_lenext[c].bits;
+    len -= c_lenext[c].bits;
+    w = lookup_huff(hdic_dist, acc);
+    if (unpack_bl(w) == 0) goto corrupt; // unassigned code.
+    acc >>= unpack_bl(w);
+    len -= unpack_bl(w);
+    c = unpack_symb(w);
+    if (c >= sizeof(c_distext) / sizeof(c_distext[0])) goto corrupt;
+    dist = c_distext[c].base + (ginflate_uint_t)(acc &
+                                                 bitmask(c_distext[c].bits));
+    acc >>= c_distext[c].bits;
+    len -= c_distext[c].bits;
+
+    copy_symbols(I, C, mlen, dist);
+    num_matches++;
+  }
+
+  GAR_STAT_ADD(literals, num_literals);
+  GAR_STAT_ADD(matches, num_matches);
+
+  I->input_p = in;
+  I->bits_acc = acc & (((ginflate_bits_t)1 << len) - 1);
+  I->bits_len = len;
+  return;
+
+corrupt:
+  error(I, c_err_corrupt);
+}
+
+
+/// Decompress a compressed block into the symbols until the last
+/// @a clean_max symbols are bytes; a match copies the symbols, or refers to
+/// the window if it begins before the chunk.
+static void symbols_compressed(ginflate_t *I, pchunk_t *C, size_t limit,
+                               size_t clean_max) {
+  while (C->num_syms - C->marked < clean_max) {
+    ginflate_uint_t l;
+
+    if (I->input_pend - I->input_p >= fast_input_min) {
+      symbols_fast(I, C, limit, clean_max);
+      if (I->infl != &inflate_compressed) break; // end of block.
+      continue;
+    }
+
+    l = decode_huff(I, I->hdic_lit);
+    if (l < 256) {
+      reserve_syms(I, C, 1, limit);
+      C->syms[C->num_syms++] = (ginflate_word_t)l;
+      GAR_STAT_ADD(literals, 1);
+    }
+    else if (l >= 257) {
+      ginflate_uint_t d, len, dist;
+      if (l - 257 >= sizeof(c_lenext) / sizeof(c_lenext[0])) {
+        error(I, c_err_corrupt);
+      }
+      len = decode_ext(I, c_lenext, l-257);
+      d = decode_huff(I, I->hdic_dist);
+      if (d >= sizeof(c_distext) / sizeof(c_distext[0])) {
+        error(I, c_err_corrupt);
+      }
+      dist = decode_ext(I, c_distext, d);
+      reserve_syms(I, C, len, limit);
+      copy_symbols(I, C, len, dist);
+      GAR_STAT_ADD(matches, 1);
+    }
+    else { // end of block.
+      I->infl = &inflate_block;
+      break;
+    }
+  }
+}
+
+
+/// Extend the bytes of the chunk to decompress them from @a C->num_bytes.
+static void grow_bytes(ginflate_t *I, pchunk_t *C, size_t limit) {
+  size_t room = limit + 1 - C->num_syms; // one more byte to find the excess.
+  size_t cap;
+
+  if (C->bytes_cap >= room) error(I, c_err_long);
+  cap = (C->bytes_cap > 0) ? C->bytes_cap * 2 : 1 << 20;
+  if (cap > room) cap = room;
+  C->bytes = _gar_realloc(C->bytes, cap, I->env);
+  C->bytes_cap = cap;
+  I->output = &C->bytes[C->num_bytes];
+}
+
+
+/// Begin decompressing the bytes after the symbols; the last window_size
+/// symbols are the history.
+static void begin_bytes(ginflate_t *I, pchunk_t *C, size_t limit) {
+  const ginflate_word_t *w = &C->syms[C->num_syms - window_size];
+  ginflate_uint_t i;
+
+  if (C->num_syms > limit) error(I, c_err_long);
+  for (i = 0; i < window_size; i++) {
+    I->ringbuf[i] = (ginflate_byte_t)w[i];
+  }
+  I->ringbuf_pos = 0;
+  I->ringbuf_len = window_size;
+  grow_bytes(I, C, limit);
+}
+
+
+/// Check whether the blocks from the bits @a a and @a b are the same; the
+/// non-final stored blocks are, if their lengths are at the same byte, since
+/// the padding bits are ignored.
+static int same_block(const pjob_t *job, gar_off_t a, gar_off_t b) {
+  return a == b ||
+         ((peek_bits(job->src, job->len, a) & 7) == 0 &&
+          (peek_bits(job->src, job->len, b) & 7) == 0 &&
+          (a + 3 + 7) / BYTE_BIT == (b + 3 + 7) / BYTE_BIT);
+}
+
+
+/// Check whether the block boundary at the bit @a bit is found in a later
+/// chunk; @a next is advanced past the boundaries before the bit.
+static int reach_boundary(const pjob_t *job, size_t *next, gar_off_t bit) {
+  const pchunk_t *chunks = job->chunks;
+  gar_off_t start;
+
+  for (; *next < job->num_chunks; (*next)++) {
+    start = chunks[*next].start;
+    if (start == no_boundary) continue;
+    if (same_block(job, start, bit)) return 1;
+    if (start > bit) break;
+  }
+  return 0;
+}
+
+
+/// Task: decompress a chunk from its boundary to the boundary of a later one.
+static void decode_chunk(pjob_t *job, size_t k) {
+  pchunk_t *C = &job->chunks[k];
+  gar_stats_scope_t scope;
+  ginflate_t *I;
+  ginflate_byte_t *q = NULL;
+  ginflate_byte_t *pend = NULL;
+  size_t next = k + 1;
+  jmp_buf env;
+
+  if (C->start == no_boundary) return;
+
+  _gar_stats_begin(&scope, job->counters);
+  if (setjmp(env)) {
+    C->failed = 1;
+    _gar_stats_end(&scope, job->counters);
+    return;
+  }
+  I = ginflate_acquire(job->pool, env);
+  ginflate_init(I);
+  if (setjmp(I->env)) {
+    gar_gfile_close(&I->gf);
+    ginflate_release(I);
+    C->failed = 1;
+    _gar_stats_end(&scope, job->counters);
+    return;
+  }
+  gar_gfile_open_memory(&I->gf, job->src, job->len, NULL, I->env);
+  reset_at(I, C->start);
+  C->num_syms = 0;
+  C->marked = 0;
+
+  for (;;) {
+    if (I->infl == &inflate_end) {
+      next = job->num_chunks; // reached the end of the data.
+      break;
+    }
+    if (I->infl == &inflate_block && !I->bfinal &&
+        reach_boundary(job, &next, bit_offset(I))) {
+      break;
+    }
+
+    if (C->bytes == NULL) {
+      // Decompress the symbols until they no longer refer to the window.
+      if (I->infl == &inflate_stored) {
+        symbols_stored(I, C, job->limit, window_size);
+      } else if (I->infl == &inflate_compressed) {
+        symbols_compressed(I, C, job->limit, window_size);
+      } else {
+        (*I->infl)(I, NULL, NULL);
+      }
+      if (C->num_syms - C->marked >= window_size) {
+        begin_bytes(I, C, job->limit);
+        q = C->bytes;
+        pend = &C->bytes[C->bytes_cap];
+      }
+    } else {
+      if (q == pend) {
+        ringbuf_update(I, q); // the history before the moved buffer.
+        C->num_bytes = q - C->bytes;
+        grow_bytes(I, C, job->limit);
+        q = I->output;
+        pend = &C->bytes[C->bytes_cap];
+      }
+      q = (*I->infl)(I, q, pend);
+    }
+  }
+  if (C->bytes != NULL) C->num_bytes = q - C->bytes;
+  C->next = next;
+
+  gar_gfile_close(&I->gf);
+  ginflate_release(I);
+  _gar_stats_end(&scope, job->counters);
+}
+
+
+/// Decompress the first block at the bit @a bit into the symbols, to see if
+/// the block is valid.
+static int try_boundary(pjob_t *job, pchunk_t *C, ginflate_t *I,
+                        gar_off_t bit) {
+  if (setjmp(I->env)) {
+    return 0;
+  }
+
+  reset_at(I, bit);
+  inflate_block(I, NULL, NULL);
+  C->num_syms = 0;
+  C->marked = 0;
+  while (I->infl != &inflate_block) {
+    if (I->infl == &inflate_stored) {
+      symbols_stored(I, C, job->limit, (size_t)-1);
+    } else {
+      symbols_compressed(I, C, job->limit, (size_t)-1);
+    }
+  }
+
+  // The next block header follows.
+  return maybe_header(job->src, job->len, bit_offset(I), 0);
+}
+
+
+/// Task: find the first block boundary in a chunk.
+static void search_chunk(pjob_t *job, size_t k) {
+  pchunk_t *C = &job->chunks[k];
+  gar_off_t end = (k + 1 < job->num_chunks) ? job->chunks[k + 1].begin :
+                  (gar_off_t)job->len * BYTE_BIT;
+  ginflate_t *volatile I = NULL;
+  gar_gfile_t gf;
+  gar_off_t bit;
+  jmp_buf env;
+
+  gar_gfile_null(&gf);
+  if (setjmp(env)) {
+    gar_gfile_close(&gf);
+    if (I != NULL) ginflate_release(I);
+    return; // no boundary is found.
+  }
+  gar_gfile_open_memory(&gf, job->src, job->len, NULL, env);
+  I = ginflate_acquire(job->pool, env);
+  ginflate_init(I);
+  I->gf = gf;
+  gar_gfile_null(&gf);
+
+  for (bit = C->begin; bit < end; bit++) {
+    if (maybe_header(job->src, job->len, bit, 1) &&
+        try_boundary(job, C, I, bit)) {
+      C->start = bit;
+      break;
+    }
+  }
+
+  gar_gfile_close(&I->gf);
+  ginflate_release(I);
+}
+
+
+/// Take the chunks until all of them are taken; the errors of the tasks are
+/// not displayed, since they can be false boundaries. The chunks are
+/// allocated by the allocator of the calling thread.
+static void *parallel_worker(void *arg) {
+  pjob_t *job = (pjob_t *)arg;
+  int silent = _gar_silent;
+  const gar_allocator_t *prev = _gar_use_allocator(job->alloc);
+  size_t i;
+
+  _gar_silent = 1;
+  while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) <
+         job->num_chunks) {
+    (*job->task)(job, i);
+  }
+  _gar_silent = silent;
+  _gar_use_allocator(prev);
+
+  return NULL;
+}
+
+
+/// Run the task for each chunk from @a first by the worker threads.
+static void run_tasks(pjob_t *job, void (*task)(pjob_t *, size_t),
+                      size_t first, pthread_t *threads) {
+  size_t num_threads = 0;
+  size_t i;
+
+  job->task = task;
+  job->next = first;
+  while (num_threads < job->num_chunks - first - 1) {
+    if (pthread_create(&threads[num_threads], NULL, &parallel_worker, job)) {
+      break; // the calling thread and the created ones do all.
+    }
+    num_threads++;
+  }
+  parallel_worker(job);
+  for (i = 0; i < num_threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+}
+
+
+/**
+ * @brief Put the chunks from the first one into the buffer, following the
+ * reached boundaries, and resolve the references to the windows.
+ * @return number of the decompressed bytes, or (size_t)-1 if the speculation
+ * is failed.
+ */
+static size_t join_chunks(const pjob_t *job, ginflate_byte_t *p, size_t n) {
+  size_t pos = 0;
+  size_t k = 0;
+  size_t i, back;
+
+  for (;;) {
+    const pchunk_t *C = &job->chunks[k];
+    if (C->failed || n - pos < C->num_syms ||
+        n - pos - C->num_syms < C->num_bytes) {
+      return (size_t)-1;
+    }
+
+    for (i = 0; i < C->num_syms; i++) {
+      ginflate_uint_t s = C->syms[i];
+      if (s < symbol_marker) {
+        p[pos + i] = (ginflate_byte_t)s;
+      } else {
+        back = window_size - (s - symbol_marker);
+        if (back > pos) return (size_t)-1; // before the data.
+        p[pos + i] = p[pos - back];
+      }
+    }
+    pos += C->num_syms;
+    if (C->num_bytes > 0) memcpy(&p[pos], C->bytes, C->num_bytes);
+    pos += C->num_bytes;
+
+    if (C->next >= job->num_chunks) return pos;
+    k = C->next;
+  }
+}
+
+
+/// Free the chunks.
+static void free_chunks(pchunk_t *chunks, size_t n) {
+  size_t i;
+  for (i = 0; chunks != NULL && i < n; i++) {
+    _gar_free(chunks[i].syms);
+    _gar_free(chunks[i].bytes);
+  }
+  _gar_free(chunks);
+}
+
+
+/// Take the whole source stream onto memory by viewing it, or by reading it
+/// onto a new memory block stored to @a buf, which is allocated in the size
+/// of the stream at once (and extended only if the stream is longer).
+static const ginflate_byte_t *take_source(const gar_gfile_t *gf, size_t *len,
+                                          void **buf, jmp_buf env) {
+  const ginflate_byte_t *src;
+  gar_off_t size;
+  size_t cap;
+  size_t n = 0;
+
+  *len = (size_t)-1;
+  src = gar_gfile_view(gf, len, env);
+  if (src != NULL) return src;
+
+  // +1 to reach the EOF without extending the block.
+  size = gar_gfile_size(gf, env);
+  cap = (size < (gar_off_t)((size_t)-1 / 2)) ? (size_t)size + 1 : 1 << 20;
+  *buf = _gar_malloc(cap, env);
+  while ((*len = gar_gfile_read(gf, (ginflate_byte_t *)*buf + n, cap - n,
+                                env)) > 0) {
+    n += *len;
+    if (n == cap) {
+      cap *= 2;
+      *buf = _gar_realloc(*buf, cap, env);
+    }
+  }
+
+  *len = n;
+  return *buf;
+}
+
+
+/**
+ * @brief Decompress the whole source stream into the buffer by the threads.
+ *
+ * The compressed data is split into chunks of @a chunk bytes or more for
+ * @a nthreads threads (0 for all the online processors). A worker finds a
+ * block boundary in each chunk, and decompresses the blocks from it until the
+ * boundary of a later chunk with the references to the unknown window before
+ * it; then the chunks are joined in the order, resolving the references by
+ * the bytes of the previous chunks. If any boundary is false or any chunk is
+ * failed, the stream is decompressed again by _gar_inflate_buffer(), so the
+ * result and the errors are the same. A source stream which cannot be viewed
+ * is read onto a memory block of its size first. The memory is allocated by
+ * the allocator of the calling thread, also in the workers. The statistics
+ * of the workers are added to @a C (can be NULL). The source stream is
+ * borrowed; it is not closed.
+ * @return number of the decompressed bytes. Raises error if the decompressed
+ * data is longer than @a n bytes.
+ */
+size_t _gar_inflate_parallel(const gar_gfile_t *gf, void *ptr, size_t n,
+                             int nthreads, gar_off_t chunk, gar_ipool_t *P,
+                             gar_counters_t *C, jmp_buf _env) {
+  jmp_buf env;
+  void *volatile buf = NULL;
+  pchunk_t *volatile chunks = NULL;
+  pthread_t *volatile threads = NULL;
+  gar_gfile_t mgf;
+  pjob_t job;
+  size_t num = 0;
+  size_t len, i;
+  size_t nout = (size_t)-1;
+  unsigned long long t;
+  gar_gfile_null(&mgf);
+
+  if (setjmp(env)) {
+    gar_gfile_close(&mgf);
+    free_chunks(chunks, num);
+    _gar_free(threads);
+    _gar_free(buf);
+    longjmp(_env, 1);
+  }
+
+  job.src = take_source(gf, &len, (void **)&buf, env);
+  job.len = len;
+  job.limit = n;
+  job.pool = P;
+  job.counters = C;
+  job.alloc = _gar_current_allocator();
+
+  if (nthreads <= 0) {
+    long m = sysconf(_SC_NPROCESSORS_ONLN);
+    nthreads = (m > 0) ? (int)m : 1;
+  }
+  if (chunk > 0 && len / chunk < (gar_off_t)nthreads) {
+    num = (size_t)(len / chunk);
+  } else {
+    num = (size_t)nthreads;
+  }
+
+  if (num >= 2) {
+    t = GAR_STAT_START();
+    chunks = _gar_malloc(sizeof(pchunk_t) * num, env);
+    memset(chunks, 0, sizeof(pchunk_t) * num);
+    for (i = 0; i < num; i++) {
+      chunks[i].begin = (gar_off_t)(len / num * i) * BYTE_BIT;
+      chunks[i].start = (i == 0) ? 0 : no_boundary;
+    }
+    job.chunks = chunks;
+    job.num_chunks = num;
+    threads = _gar_malloc(sizeof(pthread_t) * num, env);
+
+    // Find the boundaries, decompress the chunks, and join them.
+    run_tasks(&job, &search_chunk, 1, threads);
+    run_tasks(&job, &decode_chunk, 0, threads);
+    nout = join_chunks(&job, (ginflate_byte_t *)ptr, n);
+    if (nout != (size_t)-1) {
+      GAR_STAT_ADD(out_bytes, nout);
+      GAR_STAT_STOP(GAR_STAGE_INFLATE, t);
+    }
+
+    free_chunks(chunks, num);
+    chunks = NULL;
+    _gar_free(threads);
+    threads = NULL;
+  }
+
+  // Decompress the stream serially if it is not split, or if the speculation
+  // is failed.
+  if (nout == (size_t)-1) {
+    gar_gfile_open_memory(&mgf, job.src, len, NULL, env);
+    nout = _gar_inflate_buffer(&mgf, ptr, n, P, env);
+    gar_gfile_close(&mgf);
+  }
+
+  _gar_free(buf);
+  return nout;
+}
+
+
+//-----------------------------------------------------------------------------
+// Access Point Index
+
+static const char c_zindex_magic[8] = "GARZIDX1";
+
+
+/// Create an empty index.
+gar_zindex_t *_gar_zindex_new(gar_off_t span, jmp_buf env) {
+  gar_zindex_t *X = _gar_malloc(sizeof(gar_zindex_t), env);
+  X->span = (span > 0) ? span : 1;
+  X->num_points = 0;
+  X->points_cap = 0;
+  X->points = NULL;
+  return X;
+}
+
+
+/// Free an access point index.
+void gar_zindex_close(gar_zindex_t *X) {
+  size_t i;
+
+  if (X != NULL) {
+    for (i = 0; i < X->num_points; i++) {
+      _gar_free(X->points[i].window);
+    }
+    _gar_free(X->points);
+    _gar_free(X);
+  }
+}
+
+
+/**
+ * @brief Make the access point index of a compressed stream.
+ *
+ * The whole stream is decompressed once, and the access points are recorded
+ * at the block boundaries at least @a span bytes apart in the decompressed
+ * data. The source stream is borrowed; it is not closed.
+ */
+gar_zindex_t *_gar_zindex_build(const gar_gfile_t *gf, gar_off_t span,
+                                gar_ipool_t *P, jmp_buf env) {
+  ginflate_t *volatile I = NULL;
+  gar_zindex_t *volatile X = NULL;
+  ginflate_byte_t *volatile s = NULL;
+  const size_t s_size = 65536;
+
+  X = _gar_zindex_new(span, env);
+  I = ginflate_acquire(P, env);
+  if (setjmp(I->env)) {
+    _gar_free(s);
+    ginflate_release(I);
+    gar_zindex_close(X);
+    longjmp(env, 1);
+  }
+  ginflate_init(I);
+  I->gf = *gf;
+  I->build = X;
+
+  s = _gar_malloc(s_size, I->env);
+  while (ginflate(I, s, s_size) > 0) {
+  }
+
+  _gar_free(s);
+  ginflate_release(I);
+  return X;
+}
+
+
+static void encode_u64_le(ginflate_byte_t *s, gar_off_t x) {
+  int i;
+  for (i = 0; i < 8; i++) {
+    s[i] = (ginflate_byte_t)(x >> (i * BYTE_BIT));
+  }
+}
+
+
+static gar_off_t decode_u64_le(const ginflate_byte_t *s) {
+  gar_off_t x = 0;
+  int i;
+  for (i = 0; i < 8; i++) {
+    x |= (gar_off_t)s[i] << (i * BYTE_BIT);
+  }
+  return x;
+}
+
+
+/**
+ * @brief Save an access point index by the write function.
+ *
+ * The format is the magic "GARZIDX1", the span and the number of the points,
+ * followed by the points; each point is the offset in the decompressed data,
+ * the offset in bits in the compressed data, the window size and the window.
+ * The integers are 64bit little endian.
+ */
+void gar_zindex_save(const gar_zindex_t *X, gar_write_t fn, void *ud,
+                     jmp_buf env) {
+  ginflate_byte_t s[24];
+  size_t i;
+
+  memcpy(s, c_zindex_magic, 8);
+  encode_u64_le(&s[8], X->span);
+  encode_u64_le(&s[16], X->num_points);
+  (*fn)(ud, s, 24, env);
+
+  for (i = 0; i < X->num_points; i++) {
+    const zpoint_t *pt = &X->points[i];
+    encode_u64_le(&s[0], pt->out);
+    encode_u64_le(&s[8], pt->bit);
+    encode_u64_le(&s[16], pt->wlen);
+    (*fn)(ud, s, 24, env);
+    (*fn)(ud, pt->window, pt->wlen, env);
+  }
+}
+
+
+/// Load an access point index saved by gar_zindex_save().
+gar_zindex_t *gar_zindex_load(const gar_gfile_t *gf, jmp_buf _env) {
+  jmp_buf env;
+  gar_zindex_t *volatile X = NULL;
+  ginflate_byte_t s[24];
+  gar_off_t n, i;
+  zpoint_t *pt;
+
+  if (setjmp(env)) {
+    gar_zindex_close(X);
+    longjmp(_env, 1);
+  }
+
+  if (gar_gfile_read(gf, s, 24, env) != 24 ||
+      memcmp(s, c_zindex_magic, 8) != 0) {
+    _gar_error(env, c_prefix, c_err_index);
+  }
+  X = _gar_zindex_new(decode_u64_le(&s[8]), env);
+  n = decode_u64_le(&s[16]);
+
+  for (i = 0; i < n; i++) {
+    if (gar_gfile_read(gf, s, 24, env) != 24) {
+      _gar_error(env, c_prefix, c_err_index);
+    }
+    if (X->num_points == X->points_cap) {
+      size_t cap = (X->points_cap > 0) ? X->points_cap * 2 : 16;
+      X->points = _gar_realloc(X->points, sizeof(zpoint_t) * cap, env);
+      X->points_cap = cap;
+    }
+    pt = &X->points[X->num_points];
+    pt->out = decode_u64_le(&s[0]);
+    pt->bit = decode_u64_le(&s[8]);
+    pt->wlen = (ginflate_uint_t)decode_u64_le(&s[16]);
+    pt->window = NULL;
+    if (decode_u64_le(&s[16]) > window_size ||
+        (i > 0 && pt->out <= pt[-1].out)) {
+      _gar_error(env, c_prefix, c_err_index);
+    }
+    pt->window = _gar_malloc(window_size, env);
+    X->num_points++;
+    if (gar_gfile_read(gf, pt->window, pt->wlen, env) != pt->wlen) {
+      _gar_error(env, c_prefix, c_err_index);
+    }
+  }
+
+  return X;
 }